@@ -0,0 +1,46 @@
+/*
+ ============================================================================
+ Name        : exampleProgram10.cpp
+ Author      : Joao Pereira
+ Version     :
+ Copyright   : This library is creating under the MIT license
+ Description : The loggers of the registry are never destroyed, when
+               the application exits they still write the lines kept
+               in memory. A child process logs to a compressed file
+               and exits, the parent reads what it wrote
+ ============================================================================
+ */
+#include "libJPLogger.hpp"
+#include "libJPLoggerCompressed.hpp"
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <sys/wait.h>
+
+using namespace jpCppLibs;
+
+int main(void) {
+  pid_t child;
+  int status;
+
+  remove("/tmp/test10.zlog");
+  remove("/tmp/test10.zlog.idx");
+  child = fork();
+  if( 0 == child ){
+    Logger & log = getLogger("Ex10");
+    // Blocks of 1MB, a line could wait 60 seconds in memory
+    log.setCompressedFile("/tmp/test10.zlog",1048576,60);
+    log.setLogLvl("Ex10",M_LOG_NRM,M_LOG_ALLLVL);
+    log.setDeduplication("Ex10",60);
+    log.log("Ex10",M_LOG_HGH,M_LOG_INF,"Child %d started",(int)getpid());
+    for( int i = 0 ; i < 5 ; i++ )
+      log.log("Retrying the connection","Ex10",M_LOG_HGH,M_LOG_WRN);
+    log.log("Child ends","Ex10",M_LOG_HGH,M_LOG_ERR);
+    exit( 0 );
+  }
+  waitpid( child, &status, 0 );
+
+  LoggerCompressedReader reader("/tmp/test10.zlog");
+  reader.read( 0, time(NULL), std::cout );
+  return 0;
+}
@@ -0,0 +1,47 @@
+/*
+ ============================================================================
+ Name        : exampleProgram11.cpp
+ Author      : Joao Pereira
+ Version     :
+ Copyright   : This library is creating under the MIT license
+ Description : Many threads log at the same time with combined writes,
+               the thread that gets the mutex writes the logs of the
+               others. Counts the logs written to the file
+ ============================================================================
+ */
+#include "libJPLogger.hpp"
+#include <stdio.h>
+#include <thread>
+#include <vector>
+#include <fstream>
+
+using namespace jpCppLibs;
+
+static const int THREADS = 8;
+static const int LOGS = 10000;
+
+int main(void) {
+  std::vector<std::thread> threads;
+  std::string line;
+  int count = 0;
+
+  remove("/tmp/test11.log");
+  {
+    Logger log("/tmp/test11.log");
+    log.setLogLvl("Ex11",M_LOG_NRM,M_LOG_ALLLVL);
+    log.setCombining( true );
+    for( int t = 0 ; t < THREADS ; t++ )
+      threads.push_back( std::thread( [&log,t](){
+        for( int i = 0 ; i < LOGS ; i++ )
+          log.log("Ex11",M_LOG_HGH,M_LOG_INF,"Thread %d log %d",t,i);
+      } ) );
+    for( size_t t = 0 ; t < threads.size() ; t++ )
+      threads[t].join();
+  }
+
+  std::ifstream file("/tmp/test11.log");
+  while( std::getline( file, line ) )
+    count++;
+  std::cout << count << " logs written by " << THREADS << " threads" << std::endl;
+  return 0;
+}
@@ -0,0 +1,53 @@
+/*
+ ============================================================================
+ Name        : exampleProgram12.cpp
+ Author      : Joao Pereira
+ Version     :
+ Copyright   : This library is creating under the MIT license
+ Description : Changes the layout of the logs with patterns while a
+               thread logs, the logs of a static object that ends
+               after the thread storage are still written
+ ============================================================================
+ */
+#include "libJPLogger.hpp"
+#include <stdio.h>
+#include <thread>
+#include <atomic>
+
+using namespace jpCppLibs;
+
+/**
+ * Object that logs when the application ends
+ */
+struct Service{
+  ~Service(){
+    getLogger("Ex12").log("Service stopped","Ex12",M_LOG_HGH,M_LOG_INF);
+  }
+} service;
+
+int main(void) {
+  std::atomic<bool> stop(false);
+  Logger & log = getLogger("Ex12");
+
+  remove("/tmp/test12.log");
+  log.setFile("/tmp/test12.log");
+  log.setLogLvl("Ex12",M_LOG_NRM,M_LOG_ALLLVL);
+  log.log("Default layout","Ex12",M_LOG_HGH,M_LOG_INF);
+  log.setPattern("{date}.{millis} {type} {module} {file}: {message}");
+  JPLOG( log, "Ex12", M_LOG_HGH, M_LOG_INF, "Layout with the call site" );
+  log.setPattern("[{type}] {message}");
+  log.log("Layout without the date","Ex12",M_LOG_HGH,M_LOG_INF);
+
+  // The old layouts are deleted once no thread formats with them
+  std::thread worker( [&log,&stop](){
+    while( !stop.load() )
+      log.log("Ex12",M_LOG_HGH,M_LOG_INF) << "Worker log" << std::endl;
+  } );
+  for( int i = 0 ; i < 1000 ; i++ )
+    log.setPattern( ( i % 2 ) ? "{module}[{type}] {message}" : "{type} {message}" );
+  stop.store( true );
+  worker.join();
+  log.setPattern("{date} {module}[{type}]\t{message}");
+  log.log("Back to the default layout","Ex12",M_LOG_HGH,M_LOG_INF);
+  return 0;
+}
@@ -0,0 +1,72 @@
+/*
+ ============================================================================
+ Name        : exampleProgram13.cpp
+ Author      : Joao Pereira
+ Version     :
+ Copyright   : This library is creating under the MIT license
+ Description : Publishes the logs in a unix domain socket and receives
+               the errors like jplog-tail -t ERR. The debug log kept by
+               a context is written with the error but is not received.
+               A file that is not a socket is never replaced by the socket
+ ============================================================================
+ */
+#include "libJPLogger.hpp"
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <fstream>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+using namespace jpCppLibs;
+
+int main(void) {
+  struct sockaddr_un address;
+  struct timeval timeout = { 1, 0 };
+  std::string received;
+  char buffer[512];
+  ssize_t count;
+  int fd;
+
+  std::ofstream("/tmp/test13.file") << "Not a socket" << std::endl;
+  try{
+    Logger log;
+    log.setTailSocket("/tmp/test13.file");
+  }catch( LoggerExpFileError & e ){
+    std::cout << "/tmp/test13.file was kept: " << e.what() << std::endl;
+  }
+
+  remove("/tmp/test13.log");
+  Logger log("/tmp/test13.log");
+  log.setLogLvl("Ex13",M_LOG_HGH,M_LOG_ALLLVL);
+  log.setTailSocket("/tmp/test13.sock");
+
+  memset( &address, 0, sizeof(address) );
+  address.sun_family = AF_UNIX;
+  strcpy( address.sun_path, "/tmp/test13.sock" );
+  fd = socket( AF_UNIX, SOCK_STREAM, 0 );
+  if( -1 == fd || 0 != connect( fd, (struct sockaddr *)&address, sizeof(address) ) ){
+    std::cerr << "Socket could not be opened" << std::endl;
+    return 1;
+  }
+  setsockopt( fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout) );
+  // Any module, only the errors
+  send( fd, "\tERR\n", 5, MSG_NOSIGNAL );
+  // The logs published before the subscriber is accepted are not sent
+  usleep( 100000 );
+
+  {
+    LoggerContext context( &log, "request" );
+    log.log("Debug log kept by the context","Ex13",M_LOG_NRM,M_LOG_DBG);
+    log.log("Error of the request","Ex13",M_LOG_HGH,M_LOG_ERR);
+  }
+  log.log("Information log","Ex13",M_LOG_HGH,M_LOG_INF);
+  log.log("Second error","Ex13",M_LOG_HGH,M_LOG_ERR);
+
+  while( std::string::npos == received.find( "Second error" ) &&
+      0 < (count = recv( fd, buffer, sizeof(buffer), 0 )) )
+    received.append( buffer, count );
+  close( fd );
+  std::cout << "Received:" << std::endl << received;
+  return 0;
+}
@@ -0,0 +1,41 @@
+/*
+ ============================================================================
+ Name        : exampleProgram14.cpp
+ Author      : Joao Pereira
+ Version     :
+ Copyright   : This library is creating under the MIT license
+ Description : Logs binary payloads encoded in hex and in base64,
+               a long payload is cut and the payload of a log that
+               is not written is never encoded
+ ============================================================================
+ */
+#include "libJPLogger.hpp"
+#include <stdio.h>
+#include <fstream>
+
+using namespace jpCppLibs;
+
+int main(void) {
+  unsigned char packet[2048];
+  std::string line;
+
+  for( size_t i = 0 ; i < sizeof(packet) ; i++ )
+    packet[i] = (unsigned char)i;
+  remove("/tmp/test14.log");
+  {
+    Logger log("/tmp/test14.log");
+    log.setLogLvl("Ex14",M_LOG_NRM,M_LOG_ALLLVL);
+    log.log("Ex14",M_LOG_HGH,M_LOG_INF,"Packet in hex: ",LoggerBinary( packet, 16 ));
+    log.log("Ex14",M_LOG_HGH,M_LOG_INF,"Packet in base64: ",LoggerBinary( packet, 16, M_LOG_BASE64 ));
+    log.log("Ex14",M_LOG_HGH,M_LOG_INF) << "Stream with a packet " << LoggerBinary( packet, 8 ) << " and text after it" << std::endl;
+    log.log("Ex14",M_LOG_HGH,M_LOG_INF,"Long packet: ",LoggerBinary( packet, sizeof(packet), M_LOG_HEX, 32 ));
+    // Not writable, the payload is not encoded
+    log.log("Ex14",M_LOG_LOW,M_LOG_DBG) << "Discarded packet " << LoggerBinary( packet, sizeof(packet) ) << std::endl;
+  }
+
+  std::ifstream file("/tmp/test14.log");
+  while( std::getline( file, line ) )
+    std::cout << line.substr( line.find( '\t' ) + 1 ) << std::endl;
+  std::cout << "Packet written to std::cout: " << LoggerBinary( packet, 4 ) << std::endl;
+  return 0;
+}
@@ -0,0 +1,31 @@
+/*
+ ============================================================================
+ Name        : exampleProgram3.cpp
+ Author      : Joao Pereira
+ Version     :
+ Copyright   : This library is creating under the MIT license
+ Description : Shows the debug logs of a request only when it fails
+ ============================================================================
+ */
+#include "libJPLogger.hpp"
+
+using namespace jpCppLibs;
+
+void request( Logger & log, std::string id, bool fail ){
+  LoggerContext context( &log, id );
+  log.log("Request " + id + " started","Ex3",M_LOG_NRM,M_LOG_DBG);
+  log.log("Ex3",M_LOG_NRM,M_LOG_TRC) << "Request " << id << " processing" << std::endl;
+  if( fail )
+    log.log("Request " + id + " failed","Ex3",M_LOG_HGH,M_LOG_ERR);
+}
+
+int main(void) {
+  Logger log("/tmp/test.log");
+  log.setLogLvl("Ex3",M_LOG_HGH,M_LOG_ALLLVL);
+
+  // Only the debug logs of the second request will appear
+  request( log, "1", false );
+  request( log, "2", true );
+
+  return 0;
+}
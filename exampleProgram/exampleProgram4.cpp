@@ -0,0 +1,37 @@
+/*
+ ============================================================================
+ Name        : exampleProgram4.cpp
+ Author      : Joao Pereira
+ Version     :
+ Copyright   : This library is creating under the MIT license
+ Description : Switches single log call sites on and off at runtime
+ ============================================================================
+ */
+#include "libJPLogger.hpp"
+
+using namespace jpCppLibs;
+
+void work( Logger & log, int i ){
+  JPLOG(log, "Ex4", M_LOG_LOW, M_LOG_DBG, "Noisy line");
+  JPLOGF(log, "Ex4", M_LOG_HGH, M_LOG_INF, "Iteration %d", i);
+  JPLOG_STREAM(log, "Ex4", M_LOG_HGH, M_LOG_WRN) << "Stream of iteration " << i << std::endl;
+}
+
+int main(void) {
+  Logger log("/tmp/test.log");
+  log.setLogLvl("Ex4",M_LOG_NRM,M_LOG_ALLLVL);
+
+  // The noisy line is not written because of the module level
+  work( log, 0 );
+  // Switch on only the noisy line
+  LoggerCallSite::setCallSites( "*exampleProgram4.cpp:15", M_LOG_SITE_ON );
+  work( log, 1 );
+  // Switch off every call site of the module
+  LoggerCallSite::setCallSites( "Ex4", M_LOG_SITE_OFF );
+  work( log, 2 );
+  // Back to the module levels
+  LoggerCallSite::setCallSites( "*", M_LOG_SITE_DEFAULT );
+  work( log, 3 );
+
+  return 0;
+}
@@ -0,0 +1,79 @@
+/*
+ ============================================================================
+ Name        : exampleProgram5.cpp
+ Author      : Joao Pereira
+ Version     :
+ Copyright   : This library is creating under the MIT license
+ Description : Counts the memory allocations done by each kind of log
+               while several threads log, after the first logs of each
+               thread no allocation should be needed
+ ============================================================================
+ */
+#include "libJPLogger.hpp"
+#include <thread>
+#include <atomic>
+#include <vector>
+#include <stdlib.h>
+
+using namespace jpCppLibs;
+
+static std::atomic<unsigned long> allocations( 0 );
+
+void * operator new( size_t size ){
+  allocations.fetch_add( 1, std::memory_order_relaxed );
+  void * p = malloc( size ? size : 1 );
+  if( NULL == p )
+    throw std::bad_alloc();
+  return p;
+}
+void operator delete( void * p ) noexcept{
+  free( p );
+}
+
+static const int THREADS = 4;
+static const int LOGS = 10000;
+
+void work( Logger * log, int kind, int logs ){
+  for( int i = 0 ; i < logs ; i++ ){
+    switch( kind ){
+    case 0: log->log( "Line of the example", "Ex5", M_LOG_HGH, M_LOG_INF ); break;
+    case 1: log->log( "Ex5", M_LOG_HGH, M_LOG_INF, "Line %d of the example", i ); break;
+    case 2: log->log( "Ex5", M_LOG_HGH, M_LOG_INF ) << "Line " << i << " of the example" << std::endl; break;
+    }
+  }
+}
+
+int main(void) {
+  const char * names[] = { "log", "formatted log", "stream log" };
+  Logger log("/tmp/test.log");
+  log.setLogLvl("Ex5",M_LOG_NRM,M_LOG_ALLLVL);
+
+  for( int kind = 0 ; kind < 3 ; kind++ ){
+    std::atomic<int> ready( 0 ), done( 0 );
+    std::atomic<bool> start( false ), finish( false );
+    std::vector<std::thread> threads;
+    unsigned long before;
+
+    for( int i = 0 ; i < THREADS ; i++ )
+      threads.push_back( std::thread( [&log, &ready, &done, &start, &finish, kind]{
+        // The first logs of the thread fill its caches
+        work( &log, kind, 100 );
+        ready++;
+        while( !start.load() );
+        work( &log, kind, LOGS );
+        done++;
+        // The end of a thread gives its caches back
+        while( !finish.load() );
+      } ) );
+    while( THREADS != ready.load() );
+    before = allocations.load();
+    start.store( true );
+    while( THREADS != done.load() );
+    std::cout << names[kind] << ": " << (double)( allocations.load() - before ) / ( THREADS * LOGS )
+        << " allocations per log" << std::endl;
+    finish.store( true );
+    for( int i = 0 ; i < THREADS ; i++ )
+      threads[i].join();
+  }
+  return 0;
+}
@@ -0,0 +1,41 @@
+/*
+ ============================================================================
+ Name        : exampleProgram6.cpp
+ Author      : Joao Pereira
+ Version     :
+ Copyright   : This library is creating under the MIT license
+ Description : Configures modules by their hierarchy, the levels of NET
+               apply to NET.TCP and NET.UDP unless they have their own.
+               The levels can be changed while other threads log
+ ============================================================================
+ */
+#include "libJPLogger.hpp"
+#include <thread>
+#include <atomic>
+
+using namespace jpCppLibs;
+
+int main(void) {
+  Logger log("/tmp/test.log");
+  std::atomic<bool> stop( false );
+
+  log.setLogLvl("NET",M_LOG_NRM,M_LOG_ALLLVL);
+  log.setLogLvl("NET.UDP",M_LOG_HGH,M_LOG_ALLLVL);
+  log.log("Written, NET.TCP uses the levels of NET","NET.TCP",M_LOG_NRM,M_LOG_INF);
+  log.log("Not written, NET.UDP has its own levels","NET.UDP",M_LOG_NRM,M_LOG_INF);
+
+  // The levels are reapplied while a thread checks them
+  std::thread worker( [&log, &stop]{
+    for( int i = 0 ; !stop.load() ; i++ )
+      log.log("NET.TCP",M_LOG_LOW,M_LOG_DBG,"Packet %d",i);
+  } );
+  for( int i = 0 ; i < 1000 ; i++ )
+    log.setLogLvl("NET.TCP",( i % 2 ) ? M_LOG_NRM : M_LOG_HGH,M_LOG_DBG);
+  stop.store( true );
+  worker.join();
+
+  log.unsetModule("NET.UDP");
+  log.log("Written, NET.UDP uses the levels of NET again","NET.UDP",M_LOG_NRM,M_LOG_INF);
+
+  return 0;
+}
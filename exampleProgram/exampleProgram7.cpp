@@ -0,0 +1,36 @@
+/*
+ ============================================================================
+ Name        : exampleProgram7.cpp
+ Author      : Joao Pereira
+ Version     :
+ Copyright   : This library is creating under the MIT license
+ Description : Collapses the messages of a module that repeat, a line
+               with the number of repetitions and the message is written
+               when the module writes another message or the window ends
+ ============================================================================
+ */
+#include "libJPLogger.hpp"
+#include <unistd.h>
+
+using namespace jpCppLibs;
+
+int main(void) {
+  Logger log("/tmp/test.log");
+  log.setLogLvl("NET",M_LOG_NRM,M_LOG_ALLLVL);
+  log.setLogLvl("APP",M_LOG_NRM,M_LOG_ALLLVL);
+  log.setDeduplication("NET",1);
+
+  // Only the first retry is written, the others are counted
+  for( int i = 0 ; i < 5 ; i++ )
+    log.log("retry connect","NET",M_LOG_HGH,M_LOG_WRN);
+  log.log("connected","NET",M_LOG_HGH,M_LOG_INF);
+
+  // NET.TCP is collapsed as a child of NET
+  for( int i = 0 ; i < 3 ; i++ )
+    log.log("timeout","NET.TCP",M_LOG_HGH,M_LOG_WRN);
+  sleep( 2 );
+  // The window of the timeouts ended, they are written before this log
+  log.log("done","APP",M_LOG_HGH,M_LOG_INF);
+
+  return 0;
+}
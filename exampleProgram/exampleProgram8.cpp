@@ -0,0 +1,38 @@
+/*
+ ============================================================================
+ Name        : exampleProgram8.cpp
+ Author      : Joao Pereira
+ Version     :
+ Copyright   : This library is creating under the MIT license
+ Description : Writes a compressed log and reads it back with its index.
+               A block is written when it is full or when its first line
+               waited too long, so a quiet logger still reaches the file
+ ============================================================================
+ */
+#include "libJPLogger.hpp"
+#include "libJPLoggerCompressed.hpp"
+#include <stdio.h>
+#include <unistd.h>
+
+using namespace jpCppLibs;
+
+int main(void) {
+  remove("/tmp/test.zlog");
+  remove("/tmp/test.zlog.idx");
+  {
+    Logger log;
+    // Blocks of 4KB written at most 1 second after their first line
+    log.setCompressedFile("/tmp/test.zlog",4096,1);
+    log.setLogLvl("Ex8",M_LOG_NRM,M_LOG_ALLLVL);
+    for( int i = 0 ; i < 20 ; i++ )
+      log.log("Ex8",M_LOG_HGH,M_LOG_INF,"Line %d of the compressed log",i);
+    sleep( 2 );
+    LoggerCompressedReader reader("/tmp/test.zlog");
+    std::cout << reader.getBlocks().size() << " block written while the logger is open" << std::endl;
+    log.log("Written when the logger ends","Ex8",M_LOG_HGH,M_LOG_INF);
+  }
+
+  LoggerCompressedReader reader("/tmp/test.zlog");
+  reader.read( 0, time(NULL), std::cout );
+  return 0;
+}
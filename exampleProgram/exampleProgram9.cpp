@@ -0,0 +1,41 @@
+/*
+ ============================================================================
+ Name        : exampleProgram9.cpp
+ Author      : Joao Pereira
+ Version     :
+ Copyright   : This library is creating under the MIT license
+ Description : Writes an indexed log and prints the modules of its index.
+               The debug log kept by a context is written together with
+               the error, each of them is indexed with its own module
+ ============================================================================
+ */
+#include "libJPLogger.hpp"
+#include "libJPLoggerIndex.hpp"
+#include <stdio.h>
+
+using namespace jpCppLibs;
+
+int main(void) {
+  remove("/tmp/test.ilog");
+  remove("/tmp/test.ilog.tidx");
+  {
+    Logger log;
+    log.setIndexedFile("/tmp/test.ilog");
+    log.setLogLvl("REQ",M_LOG_HGH,M_LOG_ALLLVL);
+    log.setLogLvl("DB",M_LOG_HGH,M_LOG_ALLLVL);
+    log.log("Request 1 started","REQ",M_LOG_HGH,M_LOG_INF);
+    LoggerContext context( &log, "1" );
+    log.log("Query of request 1","DB",M_LOG_NRM,M_LOG_DBG);
+    log.log("Request 1 failed","REQ",M_LOG_HGH,M_LOG_ERR);
+  }
+
+  LoggerFileIndex index("/tmp/test.ilog");
+  const std::vector<LoggerIndexEntry> & entries = index.getEntries();
+  for( size_t i = 0 ; i < entries.size() ; i++ ){
+    std::cout << "Bytes " << entries[i].start << " to " << entries[i].end << " have logs of";
+    for( std::set<std::string>::const_iterator it = entries[i].modules.begin() ; it != entries[i].modules.end() ; ++it )
+      std::cout << " " << *it;
+    std::cout << std::endl;
+  }
+  return 0;
+}
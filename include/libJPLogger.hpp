@@ -26,6 +26,8 @@
 #include <memory>
 #include <iomanip>
 #include <sstream>
+#include <vector>
+#include <string.h>
 #ifdef USE_BOOST_INSTEAD_CXX11
 #include <boost/thread/mutex.hpp>
 #include <boost/scoped_ptr.hpp>
@@ -44,9 +46,12 @@ namespace std{
     };
     typedef boost::mutex mutex;
 };
+#define JPLOGGER_THREAD_LOCAL __thread
 
 #else
 #include <mutex>
+#include <atomic>
+#define JPLOGGER_THREAD_LOCAL thread_local
 #endif
 
 namespace jpCppLibs{
@@ -99,6 +104,23 @@ enum{
 	M_LOG_ALLLVL,
 	M_LOG_LASTTYPE
 };
+
+/**
+ * This enum have the states of a log call site
+ */
+enum{
+	M_LOG_SITE_NEW,
+	M_LOG_SITE_DEFAULT,
+	M_LOG_SITE_ON,
+	M_LOG_SITE_OFF
+};
+/**
+ * This enum have the encodings of binary payloads
+ */
+enum{
+	M_LOG_HEX,
+	M_LOG_BASE64
+};
 /**
  * Class the implements the exceptions of the logger
  */
@@ -156,7 +178,157 @@ typedef std::map<int,int> LogType;
  * the module and the log type and log severity
  */
 typedef std::map<std::string,LogType> LogModules;
+
+/**
+ * Class that references a string without copying it.
+ * It is built implicitly from literals and std::string
+ * so the logger does not copy the module or message
+ */
+class LoggerStringView{
+public:
+	/**
+	 * Class constructor
+	 * @param str String ended by a null character
+	 */
+	LoggerStringView( const char * str )
+	:str(str),
+	 length(strlen(str)){};
+	/**
+	 * Class constructor
+	 * @param str Characters of the string
+	 * @param length Number of characters
+	 */
+	LoggerStringView( const char * str, size_t length )
+	:str(str),
+	 length(length){};
+	/**
+	 * Class constructor
+	 * @param str String
+	 */
+	LoggerStringView( const std::string & str )
+	:str(str.data()),
+	 length(str.size()){};
+	/**
+	 * Retrieve the characters
+	 * @return The characters, not always ended by a null character
+	 */
+	inline const char * data() const{
+		return str;
+	}
+	/**
+	 * Retrieve the number of characters
+	 * @return Number of characters
+	 */
+	inline size_t size() const{
+		return length;
+	}
+	/**
+	 * Compare with other string
+	 * @param other String to compare with
+	 * @return True if they are equal
+	 */
+	inline bool operator==( const LoggerStringView & other ) const{
+		return length == other.length && 0 == memcmp( str, other.str, length );
+	}
+	/**
+	 * Write the string to a stream
+	 * @param os Stream
+	 * @param view String
+	 */
+	inline friend std::ostream & operator<<( std::ostream & os, const LoggerStringView & view ){
+		return os.write( view.str, view.length );
+	}
+private:
+	/**
+	 * Characters of the string
+	 */
+	const char * str;
+	/**
+	 * Number of characters
+	 */
+	size_t length;
+};
+
+/**
+ * Class that references a binary payload, like the contents
+ * of a packet, without copying it. The payload is only encoded
+ * when the log is written, straight into the line of the log
+ */
+class LoggerBinary{
+public:
+	/**
+	 * Class constructor
+	 * @param data Bytes of the payload
+	 * @param length Number of bytes
+	 * @param encoding Encoding of the payload, M_LOG_HEX or M_LOG_BASE64
+	 * @param maxLength Maximum number of bytes encoded, the payload is
+	 * cut after them and the number of bytes not written is added
+	 */
+	LoggerBinary( const void * data, size_t length, int encoding = M_LOG_HEX, size_t maxLength = 1024 )
+	:bytes((const unsigned char *)data),
+	 length(length),
+	 encoding(encoding),
+	 maxLength(maxLength){};
+	/**
+	 * Encode the payload at the end of a string
+	 * @param out String to write to
+	 */
+	void encode( std::string & out ) const;
+	/**
+	 * Encode the payload in a buffer
+	 * @param out Buffer of encodedSize characters
+	 * @return Number of characters written
+	 */
+	size_t encode( char * out ) const;
+	/**
+	 * Retrieve the number of characters of the encoded payload
+	 * @return Number of characters
+	 */
+	size_t encodedSize() const;
+	/**
+	 * Write the encoded payload to a stream, without
+	 * allocating memory and nothing for discarded logs
+	 * @param os Stream
+	 * @param payload Payload
+	 */
+	friend std::ostream & operator<<( std::ostream & os, const LoggerBinary & payload );
+private:
+	/**
+	 * Maximum number of characters of the text added to a cut payload
+	 */
+	static const size_t TRUNCATED_LENGTH = 96;
+	/**
+	 * Write the text added to a cut payload
+	 * @param out Buffer of TRUNCATED_LENGTH characters
+	 * @return Number of characters written, 0 if the payload is not cut
+	 */
+	size_t truncated( char * out ) const;
+	/**
+	 * Bytes of the payload
+	 */
+	const unsigned char * bytes;
+	/**
+	 * Number of bytes
+	 */
+	size_t length;
+	/**
+	 * Encoding of the payload
+	 */
+	int encoding;
+	/**
+	 * Maximum number of bytes encoded
+	 */
+	size_t maxLength;
+};
+class LoggerModuleTree;
+class LoggerReaders;
+class LoggerDedupTable;
 class LoggerTemporaryStream;
+class LoggerContext;
+class LoggerCallSite;
+class LoggerLayout;
+class LoggerTail;
+struct LoggerCombineSlot;
 
 /**
  * Class logger
@@ -192,6 +364,32 @@ public:
 	 * @return the file path and name
 	 */
 	std::string getFile();
+#ifndef USE_BOOST_INSTEAD_CXX11
+	/**
+	 * Change the filename to write to, the file is written in
+	 * blocks compressed on a background thread and an index
+	 * of the blocks is written to filename.idx
+	 * A block is written when it is full, when its first line waited
+	 * maxDelay seconds or when the logger ends, the lines waiting in
+	 * memory are lost if the process crashes
+	 * The file is not copied by copyLoggerDef
+	 * @param filename File path and name
+	 * @param blockSize Size of the blocks before compression
+	 * @param maxDelay Seconds a line waits in memory before its block is written
+	 * @return Return 0 in case of success
+	 */
+	int setCompressedFile( std::string filename, size_t blockSize = 1048576, int maxDelay = 5 );
+	/**
+	 * Change the filename to write to, an index with the position
+	 * of the logs of each module by time is written to filename.tidx
+	 * so tools like jplog-query only read the parts of the file needed
+	 * The file is not copied by copyLoggerDef
+	 * @param filename File path and name
+	 * @param bucketSeconds Seconds of each entry of the index
+	 * @return Return 0 in case of success
+	 */
+	int setIndexedFile( std::string filename, int bucketSeconds = 60 );
+#endif
 
 	/**
 	 * Writes the log
@@ -200,16 +398,27 @@ public:
 	 * @param logsev Log severity
 	 * @param type Type of the log
 	 */
-	void log(std::string message , std::string module , int logsev, int type);
+	void log(LoggerStringView message , LoggerStringView module , int logsev, int type);
 	/**
 	 * Writes the log
 	 * @param module Module that whats the message written
 	 * @param logsev Log severity
 	 * @param type Type of the log
-	 * @param format Format of the message to be written
+	 * @param format Format of the message to be written, ended by a null character
 	 * @param ... The function accept multiple parameters to add to format
 	 */
-	void log(std::string module , int logsev, int type,std::string format , ... );
+	void log(LoggerStringView module , int logsev, int type,LoggerStringView format , ... );
+	/**
+	 * Writes the log of a binary payload, the payload is only
+	 * encoded if the log is written and goes after the message.
+	 * Logs of payloads are not collapsed
+	 * @param module Module that whats the message written
+	 * @param logsev Log severity
+	 * @param type Type of the log
+	 * @param message Message written before the payload
+	 * @param payload Payload
+	 */
+	void log(LoggerStringView module , int logsev, int type, LoggerStringView message, const LoggerBinary & payload );
 	/**
 	 * Writes the log
 	 * @param module Module that whats the message written
@@ -217,12 +426,33 @@ public:
 	 * @param type Type of the log
 	 */
 #ifdef USE_BOOST_INSTEAD_CXX11
-	boost::shared_ptr<LoggerTemporaryStream> log(std::string module , int logsev, int type );
+	boost::shared_ptr<LoggerTemporaryStream> log(LoggerStringView module , int logsev, int type );
 #else
-	std::unique_ptr<LoggerTemporaryStream> log(std::string module , int logsev, int type );
+	std::unique_ptr<LoggerTemporaryStream> log(LoggerStringView module , int logsev, int type );
+	/**
+	 * Writes the log of a call site
+	 * @param site Call site that whats the message written
+	 * @param message Message to be written
+	 */
+	void log( LoggerCallSite & site, LoggerStringView message );
+	/**
+	 * Writes the log of a call site
+	 * @param site Call site that whats the message written
+	 * @param format Format of the message to be written
+	 * @param ... The function accept multiple parameters to add to format
+	 */
+	void logFormat( LoggerCallSite & site, const char * format, ... );
+	/**
+	 * Writes the log of a call site
+	 * @param site Call site that whats the message written
+	 */
+	std::unique_ptr<LoggerTemporaryStream> log( LoggerCallSite & site );
 #endif
 	/**
 	 * Change a log level of a module
+	 * Module names can be hierarchical with the parts separated
+	 * by dots, the levels of NET apply to NET.TCP unless
+	 * NET.TCP has its own levels
 	 * @param module Name of the module
 	 * @param logsev The minimum level of severity that will be shown
 	 * @param type Type of the log
@@ -234,6 +464,59 @@ public:
 	 * @return Returns 0 in case of success
 	 */
 	int unsetModule( std::string module );
+#ifndef USE_BOOST_INSTEAD_CXX11
+	/**
+	 * Collapse the messages of a module that repeat.
+	 * A message equal to the last one of the module written less
+	 * than window seconds before is not written, instead a line with
+	 * the number of repetitions and the message is written when the
+	 * module writes another message, when the window ends, noticed by
+	 * the next log of the logger, or when the logger is destroyed.
+	 * It also applies to the children of the module.
+	 * Messages written with a stream are not collapsed
+	 * @param module Name of the module
+	 * @param window Window in seconds, 0 to stop collapsing
+	 * @return Returns 0 in case of success
+	 */
+	int setDeduplication( std::string module, int window );
+	/**
+	 * Change how the threads that log at the same time write.
+	 * When combining each thread formats its log and the thread
+	 * that gets the mutex writes the logs of all the threads
+	 * waiting in one batch, the others return once their log
+	 * is written. Reduces the contention on the mutex when many
+	 * threads log at the same time
+	 * @param combine True to combine the writes
+	 * @return Returns 0 in case of success
+	 */
+	int setCombining( bool combine );
+	/**
+	 * Change the layout of the logs. The pattern is a text with
+	 * the tokens {date} date and time, {millis} milliseconds,
+	 * {thread} id of the thread, {module} module padded to 6
+	 * characters, {type} type of the log, {file} file and line
+	 * of the call site and {message} message of the log, if the
+	 * message is not in the pattern it is written at the end.
+	 * The default is "{date} {module}[{type}]\t{message}", the index
+	 * of setIndexedFile and jplog-query need logs that start with
+	 * the date followed by the module and [. When the logs do not
+	 * start with the date, jplog-unpack chooses the lines of
+	 * setCompressedFile by the times of their blocks only
+	 * @param pattern Pattern of the logs
+	 * @return Return 0 in case of success, -1 if the pattern is invalid
+	 */
+	int setPattern( std::string pattern );
+	/**
+	 * Publish the logs written to the subscribers of a unix domain
+	 * socket, like jplog-tail. The logs are kept in a ring and a
+	 * subscriber that does not keep up loses logs instead of making
+	 * the logger wait. Only one socket can be used by a logger
+	 * @param path Path of the socket
+	 * @param slots Number of logs kept in the ring
+	 * @return Return 0 in case of success, -1 if the logger already has a socket
+	 */
+	int setTailSocket( std::string path, size_t slots = 4096 );
+#endif
 
 	/**
 	 * Retrieve the log levels and modules of a logger
@@ -257,10 +540,68 @@ private:
 	 * Map between the modules and the types/levels
 	 */
 	LogModules logLvls;
+	/**
+	 * Levels of the modules resolved through the hierarchy,
+	 * rebuilt every time the levels change
+	 */
+#ifdef USE_BOOST_INSTEAD_CXX11
+	const LoggerModuleTree * levels;
+#else
+	std::atomic<const LoggerModuleTree *> levels;
+#endif
+	/**
+	 * Trees replaced that may still be in use by other threads
+	 */
+	std::vector<const LoggerModuleTree *> oldLevels;
+#ifndef USE_BOOST_INSTEAD_CXX11
+	/**
+	 * Threads reading the trees and the layout
+	 */
+	LoggerReaders * readers;
+#endif
+	/**
+	 * Deduplication window of the modules
+	 */
+	std::map<std::string,int> dedupWindows;
+#ifndef USE_BOOST_INSTEAD_CXX11
+	/**
+	 * Recent messages, created when the first module is deduplicated
+	 */
+	std::atomic<LoggerDedupTable *> dedup;
+	/**
+	 * Indicates if the writes are combined
+	 */
+	std::atomic<bool> combining;
+	/**
+	 * Logs waiting to be written when combining, newest first
+	 */
+	std::atomic<LoggerCombineSlot *> combinePending;
+	/**
+	 * Layout of the logs
+	 */
+	std::atomic<const LoggerLayout *> layout;
+	/**
+	 * Layouts replaced that may still be in use by other threads,
+	 * deleted once no thread reads them
+	 */
+	std::vector<const LoggerLayout *> oldLayouts;
+	/**
+	 * Subscribers of the logs, NULL if there is no socket
+	 */
+	std::atomic<LoggerTail *> tail;
+#endif
 	/**
 	 * Output file
 	 */
 	std::ofstream myfile;
+	/**
+	 * Output file when it is not a plain file, like a compressed one
+	 */
+	std::ostream * sink;
+	/**
+	 * Stream the logs are written to, the output file or the sink
+	 */
+	std::ostream * output;
 	/**
 	 * Default module
 	 */
@@ -277,21 +618,105 @@ private:
 	 * @param type Type of the log
 	 * @return True if can write log.
 	 */
-	bool writable( std::string module , int loglevel, int type );
+	bool writable( LoggerStringView module , int loglevel, int type );
 	/**
 	 * Writes the log
 	 * @param message Message to be written
 	 * @param module Module that whats the message written
 	 * @param type Type of the log
+	 * @param site Call site of the log, NULL if unknown
+	 */
+	int write( LoggerStringView message, LoggerStringView module , int type, const LoggerCallSite * site = NULL );
+	/**
+	 * Keeps a log that is not writable in the buffer of the
+	 * current context, to be written if an error happens
+	 * @param message Message to be written
+	 * @param module Module that whats the message written
+	 * @param type Type of the log
+	 * @param context Context that will hold the log
+	 * @param site Call site of the log, NULL if unknown
+	 * @param payload Payload written after the message, NULL if none
 	 */
-	int write( std::string message, std::string module , int type );
+	int defer( LoggerStringView message, LoggerStringView module , int type, LoggerContext * context,
+			const LoggerCallSite * site = NULL, const LoggerBinary * payload = NULL );
+	/**
+	 * Retrieve the context that should hold a log that is not writable
+	 * @param type Type of the log
+	 * @return The context or NULL if the log should be discarded
+	 */
+	LoggerContext * deferContext( int type );
+#ifndef USE_BOOST_INSTEAD_CXX11
+	/**
+	 * Check if the log of a call site should be written
+	 * @param site Call site
+	 * @return True if can write log.
+	 */
+	bool writable( LoggerCallSite & site );
+#endif
 	int write( std::string message);
 	/**
-	 * Writes the log line initial
+	 * Writes a whole log line to the output
+	 * @param message Message to be written
+	 * @param module Module that whats the message written
+	 * @param type Type of the log
+	 * @param context Context to flush before the log
+	 * @param site Call site of the log, NULL if unknown
+	 * @param payload Payload written after the message, NULL if none
+	 */
+	int writeLine( LoggerStringView message, LoggerStringView module , int type, LoggerContext * context,
+			const LoggerCallSite * site = NULL, const LoggerBinary * payload = NULL );
+#ifndef USE_BOOST_INSTEAD_CXX11
+	/**
+	 * Writes the line that tells how many times a message repeated
+	 * @param module Module of the message
+	 * @param type Type of the message
+	 * @param message Message that repeated
+	 * @param count Number of times it was not written
+	 */
+	void writeRepeated( LoggerStringView module, int type, LoggerStringView message, unsigned long count );
+	/**
+	 * Writes the lines of the messages that repeated
+	 * @param all True for all the messages, false for the ones whose window ended
+	 */
+	void drainRepeated( bool all );
+	/**
+	 * Write everything still kept in memory, the repeated messages
+	 * and the last block of the file, and remove the tail socket.
+	 * Used for the loggers that are never destroyed
+	 */
+	void finish();
+	/**
+	 * Start the line of the current thread with the logs kept
+	 * by the context, the log is formatted after them
+	 * @param context Context to flush before the log
+	 * @param module Module of the log
+	 * @param type Type of the log
+	 * @param fallback Line used once the thread started ending,
+	 * for example by the logs of static destructors
+	 * @return Line of the current thread or the fallback
+	 */
+	std::string & threadLine( LoggerContext * context, LoggerStringView module, const char * type, std::string & fallback );
+	/**
+	 * Format a log with the current layout
+	 * @param out Line the log is added to
+	 * @param message Message
+	 * @param module Module name
+	 * @param type Type of log
+	 * @param site Call site of the log, NULL if unknown
+	 * @param payload Binary data written after the message, NULL if none
+	 */
+	void formatLog( std::string & out, LoggerStringView message, LoggerStringView module,
+			const char * type, const LoggerCallSite * site = NULL, const LoggerBinary * payload = NULL ) const;
+	/**
+	 * Write a line and publish its log to the subscribers, when combining
+	 * returns once it was written by this thread or by another one
+	 * @param line Line returned by threadLine
+	 * @param start Start of the log in the line, after the logs kept by the context
 	 * @param module Module that whats the message written
 	 * @param type Type of the log
 	 */
-	int writeLineStart( std::string module , int type );
+	void commitLine( const std::string & line, size_t start, LoggerStringView module, const char * type );
+#endif
 
 	/**
 	 * Set logger level
@@ -299,6 +724,20 @@ private:
 	 * @return Return 0 in case of success
 	 */
 	int setLoggerLevel( const LogModules lvls);
+#ifndef USE_BOOST_INSTEAD_CXX11
+	/**
+	 * Replace the stream the logs are written to, the old
+	 * one is deleted once no thread writes to it
+	 * @param stream Stream that writes the file
+	 * @param filename File path and name
+	 */
+	void useSink( std::ostream * stream, std::string filename );
+#endif
+	/**
+	 * Rebuild the tree of levels from the map of levels.
+	 * Must be called with the mutex locked
+	 */
+	void buildLevels();
 
 	/**
 	 * Map of log type
@@ -310,78 +749,341 @@ private:
 	 */
 	void load();
 	friend class LoggerTemporaryStream;
+	friend class LoggerContext;
+#ifndef USE_BOOST_INSTEAD_CXX11
+	friend class LoggerRegistry;
+#endif
 };
+
+/**
+ * Class that implements a scoped context of a thread,
+ * for example a request being processed.
+ * While the context is active the trace and debug logs
+ * that are not writable are kept in a buffer. If an error
+ * is logged in the context the buffer is written before it,
+ * otherwise the buffer is discarded when the context ends.
+ */
+class LoggerContext{
+public:
+	/**
+	 * Class constructor, activates the context in the current thread
+	 * @param logger Logger the context applies to
+	 * @param name Name of the context, for example a request id
+	 * @param maxBuffered Maximum number of bytes kept in the buffer
+	 */
+	LoggerContext( Logger * logger, std::string name, size_t maxBuffered = 65536 );
+	/**
+	 * Class destructor, discards the buffer and deactivates the context
+	 */
+	~LoggerContext();
+	/**
+	 * Retrieve the innermost context of the current thread for a logger
+	 * @param logger Logger of the context
+	 * @return The context or NULL if there is none active
+	 */
+	static LoggerContext * current( const Logger * logger );
+	/**
+	 * Retrieve the name of the context
+	 * @return Name of the context
+	 */
+	const std::string & getName() const;
+	/**
+	 * Retrieve the number of bytes kept in the buffer
+	 * @return Number of bytes
+	 */
+	size_t getBufferedSize() const;
+	/**
+	 * Keep a formatted line in the buffer
+	 * @param line Line to keep
+	 */
+	void keep( const std::string & line );
+	/**
+	 * Add the buffer at the end of a line and empty it. The number of
+	 * logs that did not fit is written after it as a log with the module
+	 * and the type of the log that flushed the context
+	 * @param out Line to write to
+	 * @param module Module of the log that flushed the context
+	 * @param type Type of the log that flushed the context
+	 * @return Position of the log of the logs dropped, the size of the line if none
+	 */
+	size_t flush( std::string & out, LoggerStringView module, const char * type );
+private:
+	/**
+	 * Copy constructor
+	 */
+	LoggerContext( const LoggerContext & other );
+	/**
+	 * Attribution operator
+	 */
+	LoggerContext & operator=( const LoggerContext & other );
+	/**
+	 * Logger the context applies to
+	 */
+	const Logger * logger;
+	/**
+	 * Name of the context
+	 */
+	std::string name;
+	/**
+	 * Lines kept
+	 */
+	std::string buffer;
+	/**
+	 * Maximum number of bytes kept
+	 */
+	size_t maxBuffered;
+	/**
+	 * Number of lines that did not fit the buffer
+	 */
+	size_t dropped;
+	/**
+	 * Context that was active before this one
+	 */
+	LoggerContext * previous;
+	/**
+	 * Innermost context active in the thread
+	 */
+	static JPLOGGER_THREAD_LOCAL LoggerContext * active;
+};
+
+#ifndef USE_BOOST_INSTEAD_CXX11
+/**
+ * Class that describes a place in the code that writes logs.
+ * Each call site can be switched on or off at runtime
+ * independently of the log level of the module
+ * Instances are created by the JPLOG macros
+ */
+class LoggerCallSite{
+public:
+	/**
+	 * Class constructor, it is constant so no code runs
+	 * at the call site to build it
+	 * @param file Source file of the call site
+	 * @param line Line of the call site
+	 * @param module Module that whats the message written
+	 * @param logsev Log severity
+	 * @param type Type of the log
+	 */
+	constexpr LoggerCallSite( const char * file, int line, const char * module, int logsev, int type )
+	:file(file),
+	 line(line),
+	 module(module),
+	 logsev(logsev),
+	 type(type),
+	 flag(M_LOG_SITE_NEW),
+	 next(NULL){};
+	/**
+	 * Check if the call site was switched off
+	 * @return False if the call site is off
+	 */
+	inline bool enabled() const{
+		return M_LOG_SITE_OFF != flag.load(std::memory_order_relaxed);
+	}
+	/**
+	 * Retrieve the state of the call site, registering it if needed
+	 * @return The state
+	 */
+	int getState();
+	/**
+	 * Change the state of the call sites that match a pattern.
+	 * The pattern can use * and ? and is matched against the
+	 * file, the file:line and the module of the call site.
+	 * It is also applied to the call sites that were not yet reached
+	 * @param pattern Pattern of the call sites
+	 * @param state M_LOG_SITE_DEFAULT, M_LOG_SITE_ON or M_LOG_SITE_OFF
+	 * @return Number of call sites changed
+	 */
+	static int setCallSites( const std::string & pattern, int state );
+	/**
+	 * Retrieve all the call sites already reached
+	 * @return The call sites
+	 */
+	static std::vector<const LoggerCallSite*> getCallSites();
+	/**
+	 * Source file of the call site
+	 */
+	const char * const file;
+	/**
+	 * Line of the call site
+	 */
+	const int line;
+	/**
+	 * Module that whats the message written
+	 */
+	const char * const module;
+	/**
+	 * Log severity
+	 */
+	const int logsev;
+	/**
+	 * Type of the log
+	 */
+	const int type;
+private:
+	/**
+	 * Copy constructor
+	 */
+	LoggerCallSite( const LoggerCallSite & other );
+	/**
+	 * Attribution operator
+	 */
+	LoggerCallSite & operator=( const LoggerCallSite & other );
+	/**
+	 * Check if the call site matches a pattern
+	 * @param pattern Pattern of the call sites
+	 * @return True if it matches
+	 */
+	bool matches( const std::string & pattern ) const;
+	/**
+	 * State of the call site
+	 */
+	std::atomic<int> flag;
+	/**
+	 * Next call site registered
+	 */
+	LoggerCallSite * next;
+};
+
+/**
+ * Retrieve the call site of the place where the macro is used
+ */
+#define JPLOG_SITE( __module, __logsev, __type ) \
+		([]() -> jpCppLibs::LoggerCallSite & { \
+			static jpCppLibs::LoggerCallSite __site( __FILE__, __LINE__, __module, __logsev, __type ); \
+			return __site; \
+		}())
+/**
+ * Writes a log. If the call site is off it costs only one check
+ */
+#define JPLOG( __logger, __module, __logsev, __type, __message ) \
+		do{ \
+			jpCppLibs::LoggerCallSite & __jpsite = JPLOG_SITE( __module, __logsev, __type ); \
+			if( __jpsite.enabled() ) \
+				(__logger).log( __jpsite, __message ); \
+		}while(0)
+/**
+ * Writes a log using a format
+ */
+#define JPLOGF( __logger, __module, __logsev, __type, ... ) \
+		do{ \
+			jpCppLibs::LoggerCallSite & __jpsite = JPLOG_SITE( __module, __logsev, __type ); \
+			if( __jpsite.enabled() ) \
+				(__logger).logFormat( __jpsite, __VA_ARGS__ ); \
+		}while(0)
+/**
+ * Writes a log using a stream, the stream is not created if the call site is off
+ */
+#define JPLOG_STREAM( __logger, __module, __logsev, __type ) \
+		for( jpCppLibs::LoggerCallSite * __jpsite = &JPLOG_SITE( __module, __logsev, __type ); \
+				NULL != __jpsite && __jpsite->enabled(); __jpsite = NULL ) \
+			(__logger).log( *__jpsite )
+#endif
 /**
  * Class used as stream to write to the file
  */
 class LoggerTemporaryStream: public std::ostream
 {
+	/**
+	 * Number of bytes of the blocks that hold the module
+	 * and the message, longer messages use the heap
+	 */
+	static const size_t TEXT_BLOCK = 1024;
+	/**
+	 * Maximum length of a module kept in the block
+	 */
+	static const size_t MODULE_IN_BLOCK = 128;
 	/**
 	 * Class that holds the buffer
 	 */
-	class LoggerTemporaryBuffer: public std::stringbuf
+	class LoggerTemporaryBuffer: public std::streambuf
 	{
 		/**
 		 * Output buffer
 		 */
 		std::ostream&   output;
 		/**
-		 * Module of the log
+		 * Block with the module followed by the message,
+		 * NULL if the log is discarded
+		 */
+		char * block;
+		/**
+		 * Module of the log, in the block or in longModule
+		 */
+		LoggerStringView module;
+		/**
+		 * Module of the log when it does not fit in the block
+		 */
+		std::string longModule;
+		/**
+		 * Start of the message in the block
 		 */
-		std::string module;
+		char * messageStart;
+		/**
+		 * Start of the message when it does not fit in the block
+		 */
+		std::string longMessage;
 		/**
 		 * Type of the log
 		 */
-		std::string type;
+		const char * type;
 		/**
 		 * Mutex to synchronize file writing
 		 */
 		std::mutex *mutex;
+		/**
+		 * Context to flush before the log or to keep the log in
+		 */
+		LoggerContext *context;
+		/**
+		 * Indicates if the log should be kept in the context
+		 * instead of written
+		 */
+		bool deferred;
+		/**
+		 * Logger that writes the log, NULL if the log is
+		 * written directly to the output
+		 */
+		Logger *writer;
+		/**
+		 * Call site of the log, NULL if unknown
+		 */
+		const LoggerCallSite *site;
 	public:
 		/**
 		 * Class constructor
 		 * @param str Output buffer
-		 * @param module Module name
+		 * @param module Module name, "-1" to discard the log
 		 * @param type Type of log
 		 * @param mutex Mutex to synchronize file writing
+		 * @param context Context to flush before the log or to keep the log in
+		 * @param deferred Indicates if the log should be kept in the context
+		 * @param writer Logger that writes the log
+		 * @param site Call site of the log
 		 */
-		LoggerTemporaryBuffer(std::ostream& str, std::string module, std::string type, std::mutex *mutex)
-		:output(str),
-		 module(module),
-		 type(type),
-		 mutex(mutex){};
+		LoggerTemporaryBuffer(std::ostream& str, LoggerStringView module, const char * type, std::mutex *mutex,
+				LoggerContext *context = NULL, bool deferred = false, Logger *writer = NULL,
+				const LoggerCallSite *site = NULL);
+		/**
+		 * Class destructor, gives the block back
+		 */
+		~LoggerTemporaryBuffer();
+	protected:
+		/**
+		 * Called when the block is full, the message continues in the heap
+		 * @param c Character
+		 * @return The character
+		 */
+		virtual int_type overflow( int_type c );
 		/**
 		 * Sync function called when std::endl is passed into the stream
 		 */
-		virtual int sync ( )
-		{
-			if(0 == module.compare("-1")){
-				str("");
-				return 0;
-			}
-#ifdef USE_BOOST_INSTEAD_CXX11
-			std::lock_guard<std::mutex*> lock(mutex);
-#else
-			std::lock_guard<std::mutex> lock(*mutex);
-#endif
-			char dateResult[20];
-			{
-				struct tm *tmp;
-				time_t t = time(NULL);
-
-				tmp = localtime(&t);
-				if (strftime(dateResult, sizeof(dateResult), "%Y-%m-%d %H:%M:%S", tmp) == 0) {
-					throw LoggerExpFileError("Error writing log",true);
-				}
-			}
-
-
-			output << dateResult << " "<< std::setw(6) << module << "[" << type << "]" <<"\t";
-			output << str();
-			str("");
-			output.flush();
-			return 0;
-		}
+		virtual int sync ( );
+	public:
+		/**
+		 * Write an encoded payload, straight into the block when it fits
+		 * @param payload Payload
+		 */
+		void writePayload( const LoggerBinary & payload );
 	};
 
 	/**
@@ -395,10 +1097,62 @@ class LoggerTemporaryStream: public std::ostream
 	 * @param module Module name
 	 * @param type Type of log
 	 * @param mutex Mutex to synchronize file writing
+	 * @param context Context to flush before the log or to keep the log in
+	 * @param deferred Indicates if the log should be kept in the context
+	 * @param writer Logger that writes the log, with its current layout
+	 * @param site Call site of the log
 	 */
-	LoggerTemporaryStream(std::ostream& str, std::string module, std::string type, std::mutex* mutex)
+	LoggerTemporaryStream(std::ostream& str, LoggerStringView module, const char * type, std::mutex* mutex,
+			LoggerContext *context = NULL, bool deferred = false, Logger *writer = NULL,
+			const LoggerCallSite *site = NULL)
 	:std::ostream(&buffer)
-	,buffer(str, module, type, mutex){};
+	,buffer(str, module, type, mutex, context, deferred, writer, site){};
+	/**
+	 * Writes the line start
+	 * @param out Stream to write to
+	 * @param module Module name
+	 * @param type Type of log
+	 */
+	static void writeLineStart( std::ostream & out, LoggerStringView module, const char * type );
+	/**
+	 * Writes the line start at the end of a string
+	 * @param out String to write to
+	 * @param module Module name
+	 * @param type Type of log
+	 */
+	static void writeLineStart( std::string & out, LoggerStringView module, const char * type );
+	/**
+	 * Writes a whole log line, with the new line, at the end of a string
+	 * @param out String to write to
+	 * @param layout Layout of the log, NULL for the default layout
+	 * @param message Message of the log
+	 * @param module Module name
+	 * @param type Type of log
+	 * @param site Call site of the log, NULL if unknown
+	 * @param payload Payload written after the message, NULL if none
+	 */
+	static void formatLine( std::string & out, const LoggerLayout * layout, LoggerStringView message,
+			LoggerStringView module, const char * type, const LoggerCallSite * site,
+			const LoggerBinary * payload = NULL );
+	/**
+	 * Allocate a stream, the streams come from a pool
+	 * with a list of free streams in each thread
+	 * @param size Size of the stream
+	 * @return The memory of the stream
+	 */
+	static void * operator new( size_t size );
+	/**
+	 * Give back the memory of a stream to the pool
+	 * @param stream Memory of the stream
+	 * @param size Size of the stream
+	 */
+	static void operator delete( void * stream, size_t size );
+	/**
+	 * Write the encoded payload to the block of the log
+	 * @param os Stream
+	 * @param payload Payload
+	 */
+	friend std::ostream & operator<<( std::ostream & os, const LoggerBinary & payload );
 
 	/**
 	 * Function used to be able to write any type to the stream
@@ -430,10 +1184,53 @@ class LoggerTemporaryStream: public std::ostream
 	}
 };
 
+#ifndef USE_BOOST_INSTEAD_CXX11
+/**
+ * This class implements a registry of loggers by name.
+ * Each logger is created the first time its name is
+ * requested and is never destroyed, so the references
+ * returned stay valid even while the application is
+ * being initialized or terminated.
+ * When the application exits the loggers write what they
+ * keep in memory, the logs written after it, for example by
+ * static destructors, are still written to plain files but
+ * the ones of compressed files can be lost.
+ * Looking up a logger never locks
+ */
+class LoggerRegistry{
+public:
+	/**
+	 * Get the logger with a name, creating it if needed
+	 * @param name Name of the logger
+	 * @return The logger
+	 */
+	static Logger & getLogger( LoggerStringView name );
+private:
+	/**
+	 * Class constructor
+	 */
+	LoggerRegistry();
+	/**
+	 * Called when the application exits, finishes every logger
+	 */
+	static void atExit();
+};
+
+/**
+ * Get the logger with a name, creating it if needed
+ * @param name Name of the logger
+ * @return The logger
+ */
+inline Logger & getLogger( LoggerStringView name ){
+	return LoggerRegistry::getLogger( name );
+}
+#endif
+
 /**
  * This class implements a Singleton to the logger
  * This class should be used if you need only one
  * instance of the logger for all the application
+ * It is the logger with the empty name of the LoggerRegistry
  */
 class OneInstanceLogger{
 public:
@@ -456,19 +1253,17 @@ protected:
 	 * Attribution operator
 	 */
 	OneInstanceLogger& operator= (const OneInstanceLogger& rs);
+#ifdef USE_BOOST_INSTEAD_CXX11
 	/**
 	 * Logger instance
 	 */
-#ifdef USE_BOOST_INSTEAD_CXX11
 	static boost::shared_ptr<Logger> inst;
-#else
-	static std::unique_ptr<Logger> inst;
-#endif
 	/**
 	 * Mutex to ensure that only 1 instance
 	 * exist
 	 */
 	static std::mutex m_mutex;
+#endif
 };
 };
 
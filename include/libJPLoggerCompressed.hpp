@@ -0,0 +1,281 @@
+/**
+ *  Copyright 2012 Joao Pereira<joaopapereira@gmail.com>
+ *
+ *
+ *  This file is part of libJPLogger.
+ *
+ *  libJPSemaphores is free software: you can redistribute it and/or modify
+ *  it under the terms of the MIT License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  libJPSemaphores is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  MIT License for more details.
+ *
+ */
+#ifndef libJPLoggerCompressed_H
+#define libJPLoggerCompressed_H
+
+#include "libJPLogger.hpp"
+#ifndef USE_BOOST_INSTEAD_CXX11
+#include <deque>
+#include <thread>
+#include <condition_variable>
+#include <stdint.h>
+
+namespace jpCppLibs{
+
+/**
+ * This enum have the codecs used in the blocks
+ */
+enum{
+	M_LOG_CODEC_STORED,
+	M_LOG_CODEC_ZLIB
+};
+
+/**
+ * Entry of the index of a compressed log file.
+ * The index is a text file with the name of the log
+ * followed by .idx and one line per block
+ */
+struct LoggerBlockIndex{
+	/**
+	 * Time of the first line of the block
+	 */
+	time_t first;
+	/**
+	 * Time of the last line of the block
+	 */
+	time_t last;
+	/**
+	 * Position of the block in the log file
+	 */
+	uint64_t offset;
+	/**
+	 * Size of the block in the log file
+	 */
+	uint32_t size;
+	/**
+	 * Size of the block after decompression
+	 */
+	uint32_t rawSize;
+	/**
+	 * Codec used in the block
+	 */
+	int codec;
+};
+
+/**
+ * Buffer that splits the log in blocks of whole lines and
+ * compresses each block on a background thread. A block is
+ * written when it is full or when its first line is too old
+ */
+class LoggerCompressedBuffer: public std::streambuf{
+public:
+	/**
+	 * Class constructor
+	 * @param filename File path and name
+	 * @param blockSize Size of the blocks before compression
+	 * @param maxDelay Seconds a line waits in memory before its block is written
+	 */
+	LoggerCompressedBuffer( std::string filename, size_t blockSize, int maxDelay );
+	/**
+	 * Class destructor, writes the last block and waits for the thread
+	 */
+	~LoggerCompressedBuffer();
+	/**
+	 * Write the lines kept in memory and wait until they are in the file
+	 */
+	void drain();
+protected:
+	/**
+	 * Write one character
+	 * @param c Character
+	 * @return The character
+	 */
+	virtual int_type overflow( int_type c );
+	/**
+	 * Write a sequence of characters
+	 * @param s Characters
+	 * @param n Number of characters
+	 * @return Number of characters written
+	 */
+	virtual std::streamsize xsputn( const char * s, std::streamsize n );
+	/**
+	 * Called at the end of each line, closes the block if it is full
+	 */
+	virtual int sync();
+private:
+	/**
+	 * Block waiting to be compressed
+	 */
+	struct Block{
+		/**
+		 * Lines of the block
+		 */
+		std::string data;
+		/**
+		 * Time of the first line
+		 */
+		time_t first;
+		/**
+		 * Time of the last line
+		 */
+		time_t last;
+	};
+	/**
+	 * Copy constructor
+	 */
+	LoggerCompressedBuffer( const LoggerCompressedBuffer & other );
+	/**
+	 * Attribution operator
+	 */
+	LoggerCompressedBuffer & operator=( const LoggerCompressedBuffer & other );
+	/**
+	 * Hand the whole lines of the current block to the thread.
+	 * Must be called with the mutex of the pending blocks locked
+	 */
+	void seal();
+	/**
+	 * Function of the thread that compresses and writes the blocks
+	 */
+	void run();
+	/**
+	 * Compress and write a block
+	 * @param block Block to write
+	 */
+	void writeBlock( const Block & block );
+	/**
+	 * Block being filled
+	 */
+	Block current;
+	/**
+	 * Number of bytes of the current block that end a line
+	 */
+	size_t complete;
+	/**
+	 * Size of the blocks before compression
+	 */
+	size_t blockSize;
+	/**
+	 * Seconds a line waits in memory before its block is written
+	 */
+	int maxDelay;
+	/**
+	 * Blocks waiting for the thread
+	 */
+	std::deque<Block> pending;
+	/**
+	 * Mutex that protects the current and the pending blocks
+	 */
+	std::mutex pendingMutex;
+	/**
+	 * Signals the thread that there are blocks, that the current
+	 * block has lines or that it should stop
+	 */
+	std::condition_variable pendingCond;
+	/**
+	 * Signals that the thread wrote the blocks
+	 */
+	std::condition_variable writtenCond;
+	/**
+	 * Indicates that the thread is writing a block
+	 */
+	bool writing;
+	/**
+	 * Indicates that the thread should stop
+	 */
+	bool stop;
+	/**
+	 * Log file
+	 */
+	std::ofstream data;
+	/**
+	 * Index file
+	 */
+	std::ofstream index;
+	/**
+	 * Position of the next block in the log file
+	 */
+	uint64_t offset;
+	/**
+	 * Thread that compresses the blocks
+	 */
+	std::thread worker;
+};
+
+/**
+ * Stream that writes a compressed log file
+ */
+class LoggerCompressedStream: public std::ostream{
+	/**
+	 * Buffer
+	 */
+	LoggerCompressedBuffer buffer;
+public:
+	/**
+	 * Class constructor
+	 * @param filename File path and name
+	 * @param blockSize Size of the blocks before compression
+	 * @param maxDelay Seconds a line waits in memory before its block is written
+	 */
+	LoggerCompressedStream( std::string filename, size_t blockSize, int maxDelay )
+	:std::ostream(&buffer)
+	,buffer(filename, blockSize, maxDelay){};
+	/**
+	 * Write the lines kept in memory and wait until they are in the file
+	 */
+	void drain(){
+		buffer.drain();
+	};
+};
+
+/**
+ * Class that reads a compressed log file using its index
+ */
+class LoggerCompressedReader{
+public:
+	/**
+	 * Class constructor
+	 * @param filename File path and name
+	 */
+	LoggerCompressedReader( std::string filename );
+	/**
+	 * Retrieve the blocks of the file
+	 * @return The blocks
+	 */
+	const std::vector<LoggerBlockIndex> & getBlocks() const;
+	/**
+	 * Decompress a block
+	 * @param block Block to read
+	 * @return Lines of the block
+	 */
+	std::string readBlock( const LoggerBlockIndex & block );
+	/**
+	 * Write the lines between two times, only the blocks
+	 * that cover the times are decompressed. The lines of
+	 * the blocks at the edges of the times are chosen by the
+	 * date at their start, lines without it use the times
+	 * of their block
+	 * @param from First time
+	 * @param to Last time
+	 * @param out Stream to write to
+	 * @return Number of blocks decompressed
+	 */
+	int read( time_t from, time_t to, std::ostream & out );
+private:
+	/**
+	 * Log file
+	 */
+	std::ifstream data;
+	/**
+	 * Blocks of the file
+	 */
+	std::vector<LoggerBlockIndex> blocks;
+};
+};
+#endif
+
+#endif
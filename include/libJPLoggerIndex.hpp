@@ -0,0 +1,223 @@
+/**
+ *  Copyright 2012 Joao Pereira<joaopapereira@gmail.com>
+ *
+ *
+ *  This file is part of libJPLogger.
+ *
+ *  libJPSemaphores is free software: you can redistribute it and/or modify
+ *  it under the terms of the MIT License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  libJPSemaphores is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  MIT License for more details.
+ *
+ */
+#ifndef libJPLoggerIndex_H
+#define libJPLoggerIndex_H
+
+#include "libJPLogger.hpp"
+#ifndef USE_BOOST_INSTEAD_CXX11
+#include <set>
+#include <stdint.h>
+
+namespace jpCppLibs{
+
+/**
+ * Entry of the index of a log file.
+ * The index is a text file with the name of the log
+ * followed by .tidx and one line per entry
+ */
+struct LoggerIndexEntry{
+	/**
+	 * Start time of the entry
+	 */
+	time_t bucket;
+	/**
+	 * Seconds covered by the entry
+	 */
+	int seconds;
+	/**
+	 * Position of the first log of the entry in the log file
+	 */
+	uint64_t start;
+	/**
+	 * Position after the last log of the entry
+	 */
+	uint64_t end;
+	/**
+	 * Modules with logs in the entry
+	 */
+	std::set<std::string> modules;
+};
+
+/**
+ * Part of a log file
+ */
+struct LoggerFileRange{
+	/**
+	 * Position of the first byte
+	 */
+	uint64_t start;
+	/**
+	 * Position after the last byte
+	 */
+	uint64_t end;
+};
+
+/**
+ * Buffer that writes a log file and the index of
+ * the position of the logs by time and module.
+ * Each line is indexed on its own, a write can hold
+ * several logs
+ */
+class LoggerIndexedBuffer: public std::streambuf{
+public:
+	/**
+	 * Class constructor
+	 * @param filename File path and name
+	 * @param bucketSeconds Seconds of each entry of the index
+	 */
+	LoggerIndexedBuffer( std::string filename, int bucketSeconds );
+	/**
+	 * Class destructor, writes the last entry of the index
+	 */
+	~LoggerIndexedBuffer();
+	/**
+	 * Write the current entry to the index and flush the files
+	 */
+	void drain();
+protected:
+	/**
+	 * Write one character
+	 * @param c Character
+	 * @return The character
+	 */
+	virtual int_type overflow( int_type c );
+	/**
+	 * Write a sequence of characters
+	 * @param s Characters
+	 * @param n Number of characters
+	 * @return Number of characters written
+	 */
+	virtual std::streamsize xsputn( const char * s, std::streamsize n );
+	/**
+	 * Called at the end of each write, flushes the file
+	 */
+	virtual int sync();
+private:
+	/**
+	 * Copy constructor
+	 */
+	LoggerIndexedBuffer( const LoggerIndexedBuffer & other );
+	/**
+	 * Attribution operator
+	 */
+	LoggerIndexedBuffer & operator=( const LoggerIndexedBuffer & other );
+	/**
+	 * Keep the start of the log being written
+	 * @param s Characters
+	 * @param n Number of characters
+	 */
+	void keepHeader( const char * s, std::streamsize n );
+	/**
+	 * Add the log just ended to the current entry
+	 */
+	void indexLog();
+	/**
+	 * Write the current entry to the index
+	 */
+	void writeEntry();
+	/**
+	 * Log file
+	 */
+	std::filebuf data;
+	/**
+	 * Index file
+	 */
+	std::ofstream index;
+	/**
+	 * Position of the next byte in the log file
+	 */
+	uint64_t offset;
+	/**
+	 * Position of the log being written
+	 */
+	uint64_t logStart;
+	/**
+	 * Start of the log being written
+	 */
+	std::string header;
+	/**
+	 * Indicates that the log being written is empty
+	 */
+	bool newLog;
+	/**
+	 * Entry being filled
+	 */
+	LoggerIndexEntry current;
+};
+
+/**
+ * Stream that writes an indexed log file
+ */
+class LoggerIndexedStream: public std::ostream{
+	/**
+	 * Buffer
+	 */
+	LoggerIndexedBuffer buffer;
+public:
+	/**
+	 * Class constructor
+	 * @param filename File path and name
+	 * @param bucketSeconds Seconds of each entry of the index
+	 */
+	LoggerIndexedStream( std::string filename, int bucketSeconds )
+	:std::ostream(&buffer)
+	,buffer(filename, bucketSeconds){};
+	/**
+	 * Write the current entry to the index and flush the files
+	 */
+	void drain(){
+		buffer.drain();
+	};
+};
+
+/**
+ * Class that reads the index of a log file
+ */
+class LoggerFileIndex{
+public:
+	/**
+	 * Class constructor, a missing index is the same as an empty one
+	 * @param filename File path and name of the log
+	 */
+	LoggerFileIndex( std::string filename );
+	/**
+	 * Retrieve the entries of the index
+	 * @return The entries
+	 */
+	const std::vector<LoggerIndexEntry> & getEntries() const;
+	/**
+	 * Retrieve the parts of the log file that can have logs
+	 * of a module between two times. Parts of the file that
+	 * are not in the index are always returned
+	 * @param from First time
+	 * @param to Last time
+	 * @param module Name of the module, empty for all modules
+	 * @param size Size of the log file
+	 * @return The parts of the file, sorted and merged
+	 */
+	std::vector<LoggerFileRange> ranges( time_t from, time_t to, const std::string & module, uint64_t size ) const;
+private:
+	/**
+	 * Entries of the index
+	 */
+	std::vector<LoggerIndexEntry> entries;
+};
+};
+#endif
+
+#endif
@@ -0,0 +1,177 @@
+/**
+ *  Copyright 2012 Joao Pereira<joaopapereira@gmail.com>
+ *
+ *
+ *  This file is part of libJPLogger.
+ *
+ *  libJPSemaphores is free software: you can redistribute it and/or modify
+ *  it under the terms of the MIT License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  libJPSemaphores is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  MIT License for more details.
+ *
+ */
+#ifndef libJPLoggerTail_H
+#define libJPLoggerTail_H
+
+#include "libJPLogger.hpp"
+#ifndef USE_BOOST_INSTEAD_CXX11
+#include <thread>
+#include <stdint.h>
+
+namespace jpCppLibs{
+
+/**
+ * Class that sends the logs written to the subscribers
+ * connected to a unix domain socket.
+ * The logs are published in a ring of fixed size without
+ * locks, a thread reads the ring and sends the logs to each
+ * subscriber. A subscriber that does not keep up loses the
+ * logs overwritten in the ring and receives a line with the
+ * number of logs lost, the threads that log never wait for it.
+ * A subscriber starts by sending a line with the module and
+ * the type it wants, separated by a tab and empty for all
+ */
+class LoggerTail{
+public:
+	/**
+	 * Class constructor, starts listening in the socket.
+	 * A socket left in the path by a process that ended is
+	 * replaced, any other file in the path is an error
+	 * @param path Path of the socket
+	 * @param slots Number of logs kept in the ring
+	 */
+	LoggerTail( std::string path, size_t slots );
+	/**
+	 * Class destructor, disconnects the subscribers
+	 * and removes the socket
+	 */
+	~LoggerTail();
+	/**
+	 * Disconnect the subscribers and remove the socket,
+	 * the logs published after it are not sent
+	 */
+	void finish();
+	/**
+	 * Publish a log to the subscribers
+	 * @param module Module of the log
+	 * @param type Type of the log
+	 * @param line Formatted log, with the new line
+	 */
+	void publish( LoggerStringView module, const char * type, LoggerStringView line );
+	/**
+	 * Maximum number of bytes of a log in the ring,
+	 * including the module and the type
+	 */
+	static const size_t SLOT_BYTES = 1024;
+private:
+	/**
+	 * Copy constructor
+	 */
+	LoggerTail( const LoggerTail & other );
+	/**
+	 * Attribution operator
+	 */
+	LoggerTail & operator=( const LoggerTail & other );
+	/**
+	 * Log in the ring
+	 */
+	struct Slot{
+		/**
+		 * Twice the position of the log plus 2 when written,
+		 * an odd value while it is being written
+		 */
+		std::atomic<uint64_t> sequence;
+		/**
+		 * Lengths of the module, type and line followed by them
+		 */
+		std::atomic<uint64_t> words[SLOT_BYTES / 8 + 1];
+	};
+	/**
+	 * Subscriber connected to the socket
+	 */
+	struct Subscriber{
+		/**
+		 * Socket of the subscriber
+		 */
+		int fd;
+		/**
+		 * Position of the next log to send
+		 */
+		uint64_t next;
+		/**
+		 * Indicates that the filter was received
+		 */
+		bool ready;
+		/**
+		 * Module and type wanted, empty for all
+		 */
+		std::string module;
+		std::string type;
+		/**
+		 * Data received or waiting to be sent
+		 */
+		std::string received;
+		std::string pending;
+	};
+	/**
+	 * Result of reading a log of the ring
+	 */
+	enum ReadResult{ READ_OK, READ_NOT_WRITTEN, READ_LOST };
+	/**
+	 * Read a log from the ring
+	 * @param position Position of the log
+	 * @param record Buffer for the log, SLOT_BYTES long
+	 * @return If the log was read, is not yet written or was overwritten
+	 */
+	ReadResult read( uint64_t position, char * record );
+	/**
+	 * Add the logs of the ring the subscriber wants to its pending data
+	 * @param subscriber Subscriber
+	 */
+	void collect( Subscriber & subscriber );
+	/**
+	 * Accept subscribers and send them the logs until stopped
+	 */
+	void run();
+	/**
+	 * Path of the socket
+	 */
+	std::string path;
+	/**
+	 * Listening socket
+	 */
+	int listenFd;
+	/**
+	 * Ring of logs
+	 */
+	Slot * ring;
+	/**
+	 * Number of logs in the ring
+	 */
+	size_t slots;
+	/**
+	 * Position of the next log published
+	 */
+	std::atomic<uint64_t> head;
+	/**
+	 * Indicates that the thread should stop
+	 */
+	std::atomic<bool> stop;
+	/**
+	 * Subscribers connected
+	 */
+	std::vector<Subscriber> subscribers;
+	/**
+	 * Thread that sends the logs
+	 */
+	std::thread worker;
+};
+};
+#endif
+
+#endif
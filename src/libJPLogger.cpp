@@ -1,8 +1,16 @@
 #include "libJPLogger.hpp"
+#include "libJPLoggerCompressed.hpp"
+#include "libJPLoggerIndex.hpp"
+#include "libJPLoggerTail.hpp"
 #include <stdlib.h>
 #include <stdarg.h>
 #include <errno.h>
 #include <string.h>
+#include <stdint.h>
+#include <limits>
+#ifndef USE_BOOST_INSTEAD_CXX11
+#include <thread>
+#endif
 
 
 using namespace std;
@@ -49,7 +57,895 @@ LoggerExpFileError::what() const throw(){
 }
 
 
+namespace jpCppLibs{
+/**
+ * Class that holds the levels of every module resolved through
+ * the hierarchy of the module names. The tree is flattened in
+ * arrays so the lookup of a module only walks its name once
+ */
+class LoggerModuleTree{
+public:
+	/**
+	 * Class constructor
+	 * @param lvls Log module levels
+	 * @param defModule Module with the default level
+	 * @param windows Deduplication window of the modules
+	 */
+	LoggerModuleTree( const LogModules & lvls, const std::string & defModule,
+			const std::map<std::string,int> & windows );
+	/**
+	 * Retrieve the levels of a module
+	 * @param module Name of the module
+	 * @param length Length of the name
+	 * @return Array with the minimum severity of each type
+	 */
+	const int * find( const char * module, size_t length ) const;
+	/**
+	 * Retrieve the deduplication window of a module
+	 * @param module Name of the module
+	 * @param length Length of the name
+	 * @return Window in seconds, 0 if disabled
+	 */
+	int findWindow( const char * module, size_t length ) const;
+private:
+	/**
+	 * Module in the tree
+	 */
+	struct Node{
+		/**
+		 * Minimum severity of each type
+		 */
+		int levels[M_LOG_LASTTYPE];
+		/**
+		 * Deduplication window in seconds
+		 */
+		int window;
+		/**
+		 * Position of the first child in the edges
+		 */
+		size_t firstEdge;
+		/**
+		 * Number of children
+		 */
+		size_t edgeCount;
+	};
+	/**
+	 * Link between a module and a child
+	 */
+	struct Edge{
+		/**
+		 * Part of the name of the child
+		 */
+		std::string segment;
+		/**
+		 * Position of the child in the nodes
+		 */
+		size_t node;
+	};
+	/**
+	 * Create the node of a module and of its parents
+	 * @param module Name of the module
+	 * @param children Children of each node being built
+	 * @param parents Parent of each node being built
+	 * @return Position of the node of the module
+	 */
+	static size_t addModule( const std::string & module,
+			std::vector< std::map<std::string,size_t> > & children, std::vector<size_t> & parents );
+	/**
+	 * Retrieve the node of a module or of its closest parent
+	 * @param module Name of the module
+	 * @param length Length of the name
+	 * @return The node
+	 */
+	const Node * findNode( const char * module, size_t length ) const;
+	/**
+	 * Modules, the root is the first one
+	 */
+	std::vector<Node> nodes;
+	/**
+	 * Children of the modules sorted by name
+	 */
+	std::vector<Edge> edges;
+};
+};
+
+size_t
+LoggerModuleTree::addModule( const std::string & module,
+		std::vector< std::map<std::string,size_t> > & children, std::vector<size_t> & parents ){
+	size_t node = 0, start = 0, end;
+	do{
+		end = module.find( '.', start );
+		std::string segment = module.substr( start, std::string::npos == end ? std::string::npos : end - start );
+		std::map<std::string,size_t>::iterator child = children[node].find( segment );
+		if( children[node].end() == child ){
+			children[node][segment] = children.size();
+			children.push_back( std::map<std::string,size_t>() );
+			parents.push_back( node );
+			node = children.size() - 1;
+		}else
+			node = child->second;
+		start = end + 1;
+	}while( std::string::npos != end );
+	return node;
+}
+
+LoggerModuleTree::LoggerModuleTree( const LogModules & lvls, const std::string & defModule,
+		const std::map<std::string,int> & windows ){
+	std::vector< std::map<std::string,size_t> > children(1);
+	std::vector<size_t> parents(1, 0);
+	std::map<size_t,const LogType *> configs;
+	std::map<size_t,int> nodeWindows;
+	std::map<size_t,const LogType *>::iterator config;
+	std::map<size_t,int>::iterator nodeWindow;
+	LogModules::const_iterator it;
+	std::map<std::string,int>::const_iterator itWindow;
+	LogType::const_iterator itType;
+	size_t node, i;
+	int defLevel = 0;
+
+	it = lvls.find( defModule );
+	if( lvls.end() != it ){
+		itType = it->second.find( M_LOG_ALLLVL );
+		if( it->second.end() != itType )
+			defLevel = itType->second;
+	}
+
+	// Create the nodes of every module and of its parents
+	for( it = lvls.begin() ; it != lvls.end() ; ++it )
+		configs[addModule( it->first, children, parents )] = &it->second;
+	for( itWindow = windows.begin() ; itWindow != windows.end() ; ++itWindow )
+		nodeWindows[addModule( itWindow->first, children, parents )] = itWindow->second;
+
+	// Parents are always created before the children
+	nodes.resize( children.size() );
+	for( node = 0 ; node < nodes.size() ; node++ ){
+		config = configs.find( node );
+		for( i = M_LOG_NULLTYPE + 1 ; i < M_LOG_LASTTYPE ; i++ ){
+			if( configs.end() != config && config->second->end() != (itType = config->second->find( i )) )
+				nodes[node].levels[i] = itType->second;
+			else if( configs.end() != config && config->second->end() != (itType = config->second->find( M_LOG_ALLLVL )) )
+				nodes[node].levels[i] = itType->second;
+			else if( 0 != node )
+				nodes[node].levels[i] = nodes[parents[node]].levels[i];
+			else
+				nodes[node].levels[i] = defLevel;
+		}
+		nodes[node].levels[M_LOG_NULLTYPE] = nodes[node].levels[M_LOG_NULLTYPE + 1];
+		nodeWindow = nodeWindows.find( node );
+		if( nodeWindows.end() != nodeWindow )
+			nodes[node].window = nodeWindow->second;
+		else
+			nodes[node].window = ( 0 != node ) ? nodes[parents[node]].window : 0;
+		nodes[node].firstEdge = edges.size();
+		nodes[node].edgeCount = children[node].size();
+		for( std::map<std::string,size_t>::iterator child = children[node].begin() ; child != children[node].end() ; ++child ){
+			Edge edge;
+			edge.segment = child->first;
+			edge.node = child->second;
+			edges.push_back( edge );
+		}
+	}
+}
+
+const int *
+LoggerModuleTree::find( const char * module, size_t length ) const{
+	return findNode( module, length )->levels;
+}
+
+int
+LoggerModuleTree::findWindow( const char * module, size_t length ) const{
+	return findNode( module, length )->window;
+}
+
+const LoggerModuleTree::Node *
+LoggerModuleTree::findNode( const char * module, size_t length ) const{
+	const Node * node = &nodes[0];
+	const char * segment = module, * end = module + length, * dot;
+	std::vector<Edge>::const_iterator first, last;
+	size_t segLength, half;
+
+	while( segment <= end ){
+		dot = (const char *)memchr( segment, '.', end - segment );
+		if( NULL == dot )
+			dot = end;
+		segLength = dot - segment;
+		// Binary search of the part of the name in the children
+		first = edges.begin() + node->firstEdge;
+		last = first + node->edgeCount;
+		while( first < last ){
+			half = (last - first) / 2;
+			if( 0 > first[half].segment.compare( 0, std::string::npos, segment, segLength ) )
+				first += half + 1;
+			else
+				last = first + half;
+		}
+		if( first == edges.begin() + node->firstEdge + node->edgeCount ||
+				0 != first->segment.compare( 0, std::string::npos, segment, segLength ) )
+			break;
+		node = &nodes[first->node];
+		segment = dot + 1;
+	}
+	return node;
+}
+
+#ifndef USE_BOOST_INSTEAD_CXX11
+namespace jpCppLibs{
+/**
+ * Class that counts the threads reading the trees of levels and the
+ * layout of a logger, the ones replaced are only deleted when no thread reads.
+ * Each thread uses one of several counters so the threads that log
+ * at the same time rarely write to the same one
+ */
+class LoggerReaders{
+public:
+	/**
+	 * Class that counts the current thread as a reader while it exists
+	 */
+	class Guard{
+	public:
+		/**
+		 * Class constructor
+		 * @param readers Readers of the logger
+		 */
+		Guard( LoggerReaders * readers )
+		:counter(readers->counter()){
+			counter.fetch_add( 1 );
+		};
+		/**
+		 * Class destructor
+		 */
+		~Guard(){
+			counter.fetch_sub( 1, std::memory_order_release );
+		};
+	private:
+		/**
+		 * Counter of the thread
+		 */
+		std::atomic<unsigned long> & counter;
+	};
+	/**
+	 * Class constructor
+	 */
+	LoggerReaders();
+	/**
+	 * Check if no thread is reading, a tree replaced before
+	 * the check is no longer used when it returns true
+	 * @return True if no thread is reading
+	 */
+	bool idle() const;
+private:
+	/**
+	 * Counter alone in its cache line
+	 */
+	struct Counter{
+		std::atomic<unsigned long> count;
+		char padding[64 - sizeof(std::atomic<unsigned long>)];
+	};
+	/**
+	 * Number of counters
+	 */
+	static const size_t COUNTERS = 16;
+	/**
+	 * Retrieve the counter of the current thread
+	 * @return The counter
+	 */
+	std::atomic<unsigned long> & counter();
+	/**
+	 * Counters
+	 */
+	Counter counters[COUNTERS];
+};
+};
+
+LoggerReaders::LoggerReaders(){
+	for( size_t i = 0 ; i < COUNTERS ; i++ )
+		counters[i].count.store( 0 );
+}
+
+std::atomic<unsigned long> &
+LoggerReaders::counter(){
+	static std::atomic<size_t> threads( 0 );
+	static JPLOGGER_THREAD_LOCAL size_t index = COUNTERS;
+	if( COUNTERS == index )
+		index = threads.fetch_add( 1, std::memory_order_relaxed ) % COUNTERS;
+	return counters[index].count;
+}
+
+bool
+LoggerReaders::idle() const{
+	for( size_t i = 0 ; i < COUNTERS ; i++ )
+		if( 0 != counters[i].count.load() )
+			return false;
+	return true;
+}
+
+/**
+ * Hash that reads 8 bytes at a time
+ * @param data Data to hash
+ * @param length Length of the data
+ * @param seed Initial value
+ * @return The hash
+ */
+static uint64_t
+hashBytes( const char * data, size_t length, uint64_t seed ){
+	const uint64_t mul = 0x9E3779B97F4A7C15ULL;
+	uint64_t h = seed ^ ( length * mul ), word;
+	while( length >= sizeof(word) ){
+		memcpy( &word, data, sizeof(word) );
+		h = ( h ^ word ) * mul;
+		h ^= h >> 29;
+		data += sizeof(word);
+		length -= sizeof(word);
+	}
+	word = 0;
+	memcpy( &word, data, length );
+	h = ( h ^ word ) * mul;
+	return h ^ ( h >> 32 );
+}
+
+namespace jpCppLibs{
+/**
+ * Class that holds the last message of the deduplicated modules.
+ * Each module goes to a slot chosen by its hash, a slot in use by
+ * another thread is skipped instead of waited for
+ */
+class LoggerDedupTable{
+public:
+	/**
+	 * Message that was not written because it repeated
+	 */
+	struct Repeated{
+		/**
+		 * Module of the message
+		 */
+		std::string module;
+		/**
+		 * Type of the message
+		 */
+		int type;
+		/**
+		 * Message
+		 */
+		std::string message;
+		/**
+		 * Number of times it was not written
+		 */
+		unsigned long count;
+	};
+	/**
+	 * Class constructor
+	 */
+	LoggerDedupTable();
+	/**
+	 * Check if a message should be written
+	 * @param module Module of the message
+	 * @param type Type of the message
+	 * @param message Message
+	 * @param window Window in seconds
+	 * @param repeated Filled with the message the slot had if it repeated
+	 * @return True if the message should be written
+	 */
+	bool check( LoggerStringView module, int type, LoggerStringView message, int window, Repeated & repeated );
+	/**
+	 * Check if the window of a message that repeated ended
+	 * @return True if it ended
+	 */
+	inline bool expired() const{
+		return time(NULL) >= nextExpiry.load( std::memory_order_relaxed );
+	}
+	/**
+	 * Retrieve and clear the messages that repeated
+	 * @param repeated Filled with the messages
+	 * @param all True for all the messages, false for the ones whose
+	 * window ended, skipped if another thread is already retrieving them
+	 */
+	void drain( std::vector<Repeated> & repeated, bool all );
+private:
+	/**
+	 * Recent message
+	 */
+	struct Slot{
+		/**
+		 * Indicates if a thread is using the slot
+		 */
+		std::atomic<bool> busy;
+		/**
+		 * Hash of the message
+		 */
+		uint64_t hash;
+		/**
+		 * Module of the message
+		 */
+		std::string module;
+		/**
+		 * Type of the message
+		 */
+		int type;
+		/**
+		 * Message
+		 */
+		std::string message;
+		/**
+		 * Number of times the message was not written
+		 */
+		unsigned long count;
+		/**
+		 * Time the window of the message ends
+		 */
+		time_t expires;
+	};
+	/**
+	 * Move the end of the first window that ends earlier
+	 * @param expires End of a window
+	 */
+	void lowerExpiry( time_t expires );
+	/**
+	 * Number of slots, must be a power of 2
+	 */
+	static const size_t SLOTS = 64;
+	/**
+	 * Slots
+	 */
+	Slot slots[SLOTS];
+	/**
+	 * End of the first window of a message that repeated
+	 */
+	std::atomic<time_t> nextExpiry;
+	/**
+	 * Indicates that a thread is retrieving the messages
+	 */
+	std::atomic<bool> draining;
+};
+};
+
+LoggerDedupTable::LoggerDedupTable(){
+	for( size_t i = 0 ; i < SLOTS ; i++ ){
+		slots[i].busy.store( false );
+		slots[i].hash = 0;
+		slots[i].type = M_LOG_NULLTYPE;
+		slots[i].count = 0;
+		slots[i].expires = 0;
+	}
+	nextExpiry.store( std::numeric_limits<time_t>::max() );
+	draining.store( false );
+}
+
+void
+LoggerDedupTable::lowerExpiry( time_t expires ){
+	time_t current = nextExpiry.load( std::memory_order_relaxed );
+	while( expires < current &&
+			!nextExpiry.compare_exchange_weak( current, expires, std::memory_order_relaxed ) );
+}
+
+bool
+LoggerDedupTable::check( LoggerStringView module, int type, LoggerStringView message, int window, Repeated & repeated ){
+	uint64_t moduleHash = hashBytes( module.data(), module.size(), 0 );
+	uint64_t h = hashBytes( message.data(), message.size(), moduleHash ^ type );
+	Slot & slot = slots[moduleHash & ( SLOTS - 1 )];
+	time_t now;
+
+	repeated.count = 0;
+	if( slot.busy.exchange( true, std::memory_order_acquire ) )
+		return true;
+	now = time(NULL);
+	if( h == slot.hash && type == slot.type && now < slot.expires &&
+			module == LoggerStringView( slot.module ) && message == LoggerStringView( slot.message ) ){
+		if( 0 == slot.count++ )
+			lowerExpiry( slot.expires );
+		slot.busy.store( false, std::memory_order_release );
+		return false;
+	}
+	// The module wrote another message or the window ended
+	if( 0 != slot.count ){
+		repeated.module = slot.module;
+		repeated.type = slot.type;
+		repeated.message = slot.message;
+		repeated.count = slot.count;
+	}
+	slot.hash = h;
+	slot.module.assign( module.data(), module.size() );
+	slot.type = type;
+	slot.message.assign( message.data(), message.size() );
+	slot.count = 0;
+	slot.expires = now + window;
+	slot.busy.store( false, std::memory_order_release );
+	return true;
+}
+
+void
+LoggerDedupTable::drain( std::vector<Repeated> & repeated, bool all ){
+	time_t now = all ? std::numeric_limits<time_t>::max() : time(NULL);
+	Repeated aux;
+
+	if( all )
+		while( draining.exchange( true, std::memory_order_acquire ) );
+	else if( draining.exchange( true, std::memory_order_acquire ) )
+		return;
+	// The windows that do not end now are set again while the slots are read
+	nextExpiry.store( std::numeric_limits<time_t>::max() );
+	for( size_t i = 0 ; i < SLOTS ; i++ ){
+		while( slots[i].busy.exchange( true, std::memory_order_acquire ) );
+		if( 0 != slots[i].count && now >= slots[i].expires ){
+			aux.module = slots[i].module;
+			aux.type = slots[i].type;
+			aux.message = slots[i].message;
+			aux.count = slots[i].count;
+			repeated.push_back( aux );
+			slots[i].count = 0;
+		}else if( 0 != slots[i].count )
+			lowerExpiry( slots[i].expires );
+		slots[i].busy.store( false, std::memory_order_release );
+	}
+	draining.store( false, std::memory_order_release );
+}
+#endif
+
+/**
+ * Format a date as written at the start of the logs, the last
+ * date formatted by the thread is kept since most logs of a
+ * thread are written in the same second
+ * @param t Date
+ * @return The date, 19 characters ended by a null character
+ */
+static const char *
+formatDate( time_t t ){
+	static JPLOGGER_THREAD_LOCAL time_t lastTime = -1;
+	static JPLOGGER_THREAD_LOCAL char dateResult[20];
+	struct tm tmp;
+
+	if( t == lastTime )
+		return dateResult;
+	if (NULL == localtime_r(&t, &tmp) ||
+			strftime(dateResult, sizeof(dateResult), "%Y-%m-%d %H:%M:%S", &tmp) == 0) {
+		lastTime = -1;
+		throw LoggerExpFileError("Error writing log",true);
+	}
+	lastTime = t;
+	return dateResult;
+}
+
+#ifndef USE_BOOST_INSTEAD_CXX11
+/**
+ * Pattern of the default layout
+ */
+static const char * DEFAULT_PATTERN = "{date} {module}[{type}]\t{message}";
+
+/**
+ * Parts of a layout
+ */
+enum{
+	M_LOG_LAYOUT_TEXT,
+	M_LOG_LAYOUT_DATE,
+	M_LOG_LAYOUT_MILLIS,
+	M_LOG_LAYOUT_THREAD,
+	M_LOG_LAYOUT_MODULE,
+	M_LOG_LAYOUT_TYPE,
+	M_LOG_LAYOUT_FILE,
+	M_LOG_LAYOUT_MESSAGE,
+	/**
+	 * Text, modules and types in a row, rendered once
+	 * for each module and type
+	 */
+	M_LOG_LAYOUT_RENDERED
+};
+
+namespace jpCppLibs{
+/**
+ * Class that holds a layout compiled from a pattern.
+ * The parts that only depend on the module and the type are
+ * rendered the first time a module and type are written, after
+ * that they are copied
+ */
+class LoggerLayout{
+public:
+	/**
+	 * Compile a pattern
+	 * @param pattern Pattern of the logs
+	 * @return The layout or NULL if the pattern is invalid
+	 */
+	static LoggerLayout * compile( const std::string & pattern );
+	/**
+	 * Class destructor
+	 */
+	~LoggerLayout();
+	/**
+	 * Writes a whole log line, with the new line, at the end of a string
+	 * @param out String to write to
+	 * @param message Message of the log
+	 * @param module Module name
+	 * @param type Type of log
+	 * @param site Call site of the log, NULL if unknown
+	 * @param payload Payload written after the message, NULL if none
+	 */
+	void format( std::string & out, LoggerStringView message, LoggerStringView module,
+			const char * type, const LoggerCallSite * site, const LoggerBinary * payload ) const;
+private:
+	/**
+	 * Part of the pattern
+	 */
+	struct Part{
+		/**
+		 * Kind of part, M_LOG_LAYOUT_*
+		 */
+		int kind;
+		/**
+		 * Text of the part
+		 */
+		std::string text;
+		/**
+		 * Position of the parts joined by a rendered step
+		 */
+		size_t first, last;
+		/**
+		 * Position of a rendered step among the rendered steps
+		 */
+		size_t index;
+	};
+	/**
+	 * Module and type already rendered
+	 */
+	struct Rendered{
+		uint64_t hash;
+		std::string module;
+		std::string type;
+		/**
+		 * Rendered parts one after the other
+		 */
+		std::string text;
+		/**
+		 * End of each rendered part in the text
+		 */
+		std::vector<size_t> ends;
+		Rendered * next;
+	};
+	/**
+	 * Number of lists of rendered modules and types
+	 */
+	static const size_t BUCKETS = 64;
+	/**
+	 * Maximum number of modules and types rendered,
+	 * the others are rendered every time
+	 */
+	static const size_t MAX_RENDERED = 4096;
+	/**
+	 * Class constructor
+	 */
+	LoggerLayout();
+	/**
+	 * Retrieve the rendered parts of a module and type
+	 * @param module Module name
+	 * @param type Type of log
+	 * @return The rendered parts or NULL if too many were rendered
+	 */
+	const Rendered * find( LoggerStringView module, const char * type ) const;
+	/**
+	 * Render the parts that only depend on the module and type
+	 * @param out String to write to
+	 * @param part Rendered part
+	 * @param module Module name
+	 * @param type Type of log
+	 */
+	void render( std::string & out, const Part & part, LoggerStringView module, const char * type ) const;
+	/**
+	 * Steps of the layout, text, modules and types in a row are
+	 * joined in a rendered step
+	 */
+	std::vector<Part> steps;
+	/**
+	 * Parts joined by the rendered steps
+	 */
+	std::vector<Part> parts;
+	/**
+	 * Number of rendered steps
+	 */
+	size_t renderedSteps;
+	/**
+	 * Indicates if the date or the milliseconds are used
+	 */
+	bool usesTime;
+	/**
+	 * Indicates if the message is in the pattern
+	 */
+	bool hasMessage;
+	/**
+	 * Modules and types rendered
+	 */
+	mutable std::atomic<Rendered *> rendered[BUCKETS];
+	/**
+	 * Number of modules and types rendered
+	 */
+	mutable std::atomic<size_t> renderedCount;
+};
+}
+
+LoggerLayout::LoggerLayout():
+		renderedSteps(0),
+		usesTime(false),
+		hasMessage(false),
+		renderedCount(0){
+	for( size_t i = 0 ; i < BUCKETS ; i++ )
+		rendered[i] = NULL;
+}
+
+LoggerLayout::~LoggerLayout(){
+	Rendered * entry, * next;
+	for( size_t i = 0 ; i < BUCKETS ; i++ )
+		for( entry = rendered[i].load() ; NULL != entry ; entry = next ){
+			next = entry->next;
+			delete entry;
+		}
+}
+
+LoggerLayout *
+LoggerLayout::compile( const std::string & pattern ){
+	static const char * TOKENS[] = { "", "date", "millis", "thread", "module", "type", "file", "message" };
+	std::unique_ptr<LoggerLayout> layout( new LoggerLayout() );
+	std::vector<Part> & steps = layout->steps;
+	std::string name;
+	size_t pos = 0, open, close;
+	Part part;
+
+	while( pos < pattern.size() ){
+		open = pattern.find( '{', pos );
+		part.kind = M_LOG_LAYOUT_TEXT;
+		part.text = pattern.substr( pos, open - pos );
+		if( 0 == part.text.size() ){
+			close = pattern.find( '}', open );
+			if( std::string::npos == close )
+				return NULL;
+			name = pattern.substr( open + 1, close - open - 1 );
+			for( part.kind = M_LOG_LAYOUT_DATE ; part.kind <= M_LOG_LAYOUT_MESSAGE && name != TOKENS[part.kind] ; part.kind++ );
+			if( part.kind > M_LOG_LAYOUT_MESSAGE ||
+					( M_LOG_LAYOUT_MESSAGE == part.kind && layout->hasMessage ) )
+				return NULL;
+			part.text.clear();
+			pos = close + 1;
+		}else{
+			pos = ( std::string::npos == open ) ? pattern.size() : open;
+		}
+		layout->usesTime = layout->usesTime || M_LOG_LAYOUT_DATE == part.kind || M_LOG_LAYOUT_MILLIS == part.kind;
+		layout->hasMessage = layout->hasMessage || M_LOG_LAYOUT_MESSAGE == part.kind;
+		if( M_LOG_LAYOUT_TEXT != part.kind && M_LOG_LAYOUT_MODULE != part.kind && M_LOG_LAYOUT_TYPE != part.kind ){
+			steps.push_back( part );
+			continue;
+		}
+		// Joined to the rendered step before it
+		if( steps.empty() || M_LOG_LAYOUT_RENDERED != steps.back().kind ){
+			Part step;
+			step.kind = M_LOG_LAYOUT_RENDERED;
+			step.first = step.last = layout->parts.size();
+			step.index = layout->renderedSteps++;
+			steps.push_back( step );
+		}
+		layout->parts.push_back( part );
+		steps.back().last = layout->parts.size();
+	}
+	return layout.release();
+}
+
+void
+LoggerLayout::render( std::string & out, const Part & step, LoggerStringView module, const char * type ) const{
+	for( size_t i = step.first ; i < step.last ; i++ ){
+		switch( parts[i].kind ){
+		case M_LOG_LAYOUT_TEXT:
+			out += parts[i].text;
+			break;
+		case M_LOG_LAYOUT_MODULE:
+			// Modules are padded to 6 characters to align the types
+			if( module.size() < 6 )
+				out.append( 6 - module.size(), ' ' );
+			out.append( module.data(), module.size() );
+			break;
+		case M_LOG_LAYOUT_TYPE:
+			out += type;
+			break;
+		}
+	}
+}
+
+const LoggerLayout::Rendered *
+LoggerLayout::find( LoggerStringView module, const char * type ) const{
+	size_t typeLength = strlen( type );
+	uint64_t hash = hashBytes( module.data(), module.size(), hashBytes( type, typeLength, 0 ) );
+	std::atomic<Rendered *> & bucket = rendered[hash % BUCKETS];
+	Rendered * head = bucket.load( std::memory_order_acquire ), * entry, * last = NULL;
+
+	for( ;; ){
+		for( entry = head ; last != entry ; entry = entry->next )
+			if( hash == entry->hash && module == entry->module && 0 == entry->type.compare( type ) )
+				return entry;
+		if( MAX_RENDERED <= renderedCount.load( std::memory_order_relaxed ) )
+			return NULL;
+		std::unique_ptr<Rendered> created( new Rendered() );
+		created->hash = hash;
+		created->module.assign( module.data(), module.size() );
+		created->type.assign( type, typeLength );
+		for( size_t i = 0 ; i < steps.size() ; i++ )
+			if( M_LOG_LAYOUT_RENDERED == steps[i].kind ){
+				render( created->text, steps[i], module, type );
+				created->ends.push_back( created->text.size() );
+			}
+		created->next = head;
+		if( bucket.compare_exchange_strong( head, created.get(),
+				std::memory_order_acq_rel, std::memory_order_acquire ) ){
+			renderedCount.fetch_add( 1, std::memory_order_relaxed );
+			return created.release();
+		}
+		// Another thread added entries, only those need to be checked
+		last = created->next;
+	}
+}
+
+/**
+ * Retrieve the id of the current thread as text, kept in a
+ * plain array that is still valid while the thread ends
+ * @return The id
+ */
+static const char *
+threadId(){
+	static thread_local char id[32];
+	if( '\0' == id[0] ){
+		std::ostringstream aux;
+		aux << std::this_thread::get_id();
+		snprintf( id, sizeof(id), "%s", aux.str().c_str() );
+	}
+	return id;
+}
+
+void
+LoggerLayout::format( std::string & out, LoggerStringView message, LoggerStringView module,
+		const char * type, const LoggerCallSite * site, const LoggerBinary * payload ) const{
+	const Rendered * entry = ( 0 == renderedSteps ) ? NULL : find( module, type );
+	struct timespec now = { 0, 0 };
+	char number[16];
+	size_t start;
 
+	if( usesTime && 0 != clock_gettime( CLOCK_REALTIME, &now ) )
+		throw LoggerExpFileError("Error writing log",true);
+	for( size_t i = 0 ; i < steps.size() ; i++ ){
+		const Part & step = steps[i];
+		switch( step.kind ){
+		case M_LOG_LAYOUT_RENDERED:
+			if( NULL == entry ){
+				render( out, step, module, type );
+				break;
+			}
+			start = ( 0 == step.index ) ? 0 : entry->ends[step.index - 1];
+			out.append( entry->text, start, entry->ends[step.index] - start );
+			break;
+		case M_LOG_LAYOUT_DATE:
+			out.append( formatDate( now.tv_sec ), 19 );
+			break;
+		case M_LOG_LAYOUT_MILLIS:
+			number[0] = '0' + now.tv_nsec / 100000000;
+			number[1] = '0' + now.tv_nsec / 10000000 % 10;
+			number[2] = '0' + now.tv_nsec / 1000000 % 10;
+			out.append( number, 3 );
+			break;
+		case M_LOG_LAYOUT_THREAD:
+			out += threadId();
+			break;
+		case M_LOG_LAYOUT_FILE:
+			if( NULL == site )
+				break;
+			out += site->file;
+			out.append( number, snprintf( number, sizeof(number), ":%d", site->line ) );
+			break;
+		case M_LOG_LAYOUT_MESSAGE:
+			out.append( message.data(), message.size() );
+			if( NULL != payload )
+				payload->encode( out );
+			break;
+		}
+	}
+	if( !hasMessage ){
+		out.append( message.data(), message.size() );
+		if( NULL != payload )
+			payload->encode( out );
+	}
+	out.push_back( '\n' );
+}
+#endif
 
 Logger::Logger( std::string filename )
 {
@@ -70,6 +966,19 @@ Logger::Logger(Logger * logger)
 
 void
 Logger::load(){
+	levels = NULL;
+#ifndef USE_BOOST_INSTEAD_CXX11
+	readers = new LoggerReaders();
+#endif
+	sink = NULL;
+	output = &myfile;
+#ifndef USE_BOOST_INSTEAD_CXX11
+	dedup = NULL;
+	combining = false;
+	combinePending = NULL;
+	layout = LoggerLayout::compile( DEFAULT_PATTERN );
+	tail = NULL;
+#endif
 	CONST_DEFMODULE = "ALL";
 #ifndef DEBUG
 	setLogLvl( CONST_DEFMODULE, M_LOG_MIN, M_LOG_ALLLVL );
@@ -86,12 +995,60 @@ Logger::load(){
 }
 
 Logger::~Logger(){
+#ifndef USE_BOOST_INSTEAD_CXX11
+	drainRepeated( true );
+	delete dedup.load();
+	delete sink;
+	delete tail.load();
+	delete layout.load();
+	for( size_t i = 0 ; i < oldLayouts.size() ; i++ )
+		delete oldLayouts[i];
+#endif
 	myfile.close();
+#ifdef USE_BOOST_INSTEAD_CXX11
+	delete levels;
+#else
+	delete levels.load();
+#endif
+	for( size_t i = 0 ; i < oldLevels.size() ; i++ )
+		delete oldLevels[i];
+#ifndef USE_BOOST_INSTEAD_CXX11
+	delete readers;
+#endif
+}
+
+#ifndef USE_BOOST_INSTEAD_CXX11
+void
+Logger::finish(){
+	LoggerCompressedStream * compressed;
+	LoggerIndexedStream * indexed;
+
+	drainRepeated( true );
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		if( NULL != (compressed = dynamic_cast<LoggerCompressedStream *>( sink )) )
+			compressed->drain();
+		else if( NULL != (indexed = dynamic_cast<LoggerIndexedStream *>( sink )) )
+			indexed->drain();
+		output->flush();
+	}
+	if( NULL != tail.load() )
+		tail.load()->finish();
 }
+#endif
 
 int
 Logger::setFile(std::string filename ){
 	debugFun( "change filename["<<filename.c_str()<<"]\n");
+	// Other threads write to the output while they hold the mutex
+#ifdef USE_BOOST_INSTEAD_CXX11
+	std::lock_guard<std::mutex*> lock(&mutex);
+#else
+	std::lock_guard<std::mutex> lock(mutex);
+	output = &myfile;
+	delete sink;
+	sink = NULL;
+#endif
 	if(myfile.is_open()){
 		myfile.close();
 	}
@@ -110,8 +1067,40 @@ Logger::setFile(std::string filename ){
  */
 std::string
 Logger::getFile(){
+#ifdef USE_BOOST_INSTEAD_CXX11
+	std::lock_guard<std::mutex*> lock(&mutex);
+#else
+	std::lock_guard<std::mutex> lock(mutex);
+#endif
 	return outputFile;
 }
+#ifndef USE_BOOST_INSTEAD_CXX11
+void
+Logger::useSink( std::ostream * stream, std::string filename ){
+	// Other threads write to the output while they hold the mutex
+	std::lock_guard<std::mutex> lock(mutex);
+	output = stream;
+	delete sink;
+	sink = stream;
+	if(myfile.is_open()){
+		myfile.close();
+	}
+	outputFile = filename;
+}
+int
+Logger::setCompressedFile( std::string filename, size_t blockSize, int maxDelay ){
+	debugFun( "change compressed filename["<<filename.c_str()<<"]\n");
+	// The file is opened before the logs are redirected to it
+	useSink( new LoggerCompressedStream( filename, blockSize, maxDelay ), filename );
+	return 0;
+}
+int
+Logger::setIndexedFile( std::string filename, int bucketSeconds ){
+	debugFun( "change indexed filename["<<filename.c_str()<<"]\n");
+	useSink( new LoggerIndexedStream( filename, bucketSeconds ), filename );
+	return 0;
+}
+#endif
 
 
 int
@@ -136,6 +1125,11 @@ Logger::setLogLvl( std::string module , int logsev, int type)
 
 	aux.insert( pair<int,int>(actType,actlogsev));
 
+#ifdef USE_BOOST_INSTEAD_CXX11
+	std::lock_guard<std::mutex*> lock(&mutex);
+#else
+	std::lock_guard<std::mutex> lock(mutex);
+#endif
 	it = Logger::logLvls.find( module );
 
 	if(  Logger::logLvls.end() == it  ){
@@ -149,14 +1143,77 @@ Logger::setLogLvl( std::string module , int logsev, int type)
 	}
 
 	//cout << logLvls << endl;
+	buildLevels();
 
 	return 0;
 }
 int
 Logger::unsetModule( std::string module ){
+#ifdef USE_BOOST_INSTEAD_CXX11
+	std::lock_guard<std::mutex*> lock(&mutex);
+#else
+	std::lock_guard<std::mutex> lock(mutex);
+#endif
 	Logger::logLvls.erase( module );
+	buildLevels();
+	return 0;
+}
+
+#ifndef USE_BOOST_INSTEAD_CXX11
+void
+Logger::writeRepeated( LoggerStringView module, int type, LoggerStringView message, unsigned long count ){
+	char prefix[64];
+	std::string text( prefix, snprintf( prefix, sizeof(prefix), "Last message repeated %lu times: ", count ) );
+	text.append( message.data(), message.size() );
+	writeLine( text, module, type, NULL );
+}
+
+void
+Logger::drainRepeated( bool all ){
+	LoggerDedupTable * table = dedup.load( std::memory_order_acquire );
+	std::vector<LoggerDedupTable::Repeated> repeated;
+	if( NULL == table )
+		return;
+	table->drain( repeated, all );
+	for( size_t i = 0 ; i < repeated.size() ; i++ )
+		writeRepeated( repeated[i].module, repeated[i].type, repeated[i].message, repeated[i].count );
+}
+
+int
+Logger::setDeduplication( std::string module, int window ){
+	std::lock_guard<std::mutex> lock(mutex);
+	if( window <= 0 )
+		dedupWindows.erase( module );
+	else
+		dedupWindows[module] = window;
+	if( NULL == dedup.load() )
+		dedup.store( new LoggerDedupTable() );
+	buildLevels();
 	return 0;
 }
+#endif
+
+void
+Logger::buildLevels(){
+	const LoggerModuleTree * tree = new LoggerModuleTree( logLvls, CONST_DEFMODULE, dedupWindows );
+#ifdef USE_BOOST_INSTEAD_CXX11
+	const LoggerModuleTree * old = levels;
+	levels = tree;
+	// Readers do not lock so the old tree is only deleted with the logger
+	if( NULL != old )
+		oldLevels.push_back( old );
+#else
+	const LoggerModuleTree * old = levels.exchange( tree );
+	if( NULL != old )
+		oldLevels.push_back( old );
+	// Readers do not lock, the old trees are deleted once no thread reads them
+	if( readers->idle() ){
+		for( size_t i = 0 ; i < oldLevels.size() ; i++ )
+			delete oldLevels[i];
+		oldLevels.clear();
+	}
+#endif
+}
 
 /**
  * Retrieve the log levels and modules of a logger
@@ -168,45 +1225,85 @@ Logger::getLogLvls(){
 }
 
 
-void Logger::log( std::string message , std::string module , int logsev, int type)
+void Logger::log( LoggerStringView message , LoggerStringView module , int logsev, int type)
 {
-	LogModules::iterator it;
-	LogType::iterator it1;
+	LoggerContext * context;
 
 	try{
 		if( writable(module , logsev, type ) )
 			write( message , module , type );
+		else if( NULL != (context = deferContext( type )) )
+			defer( message , module , type, context );
+	}catch( LoggerExpFileError &e ){
+		cerr << e.what();
+	}
+}
+void Logger::log( LoggerStringView module , int logsev, int type, LoggerStringView message, const LoggerBinary & payload )
+{
+	LoggerContext * context;
+
+	try{
+		if( writable(module , logsev, type ) )
+			writeLine( message , module , type, ( M_LOG_ERR == type ) ? LoggerContext::current( this ) : NULL, NULL, &payload );
+		else if( NULL != (context = deferContext( type )) )
+			defer( message , module , type, context, NULL, &payload );
 	}catch( LoggerExpFileError &e ){
 		cerr << e.what();
 	}
 }
-void Logger::log( std::string module , int logsev, int type, std::string message ,...)
+void Logger::log( LoggerStringView module , int logsev, int type, LoggerStringView message ,...)
 {
 	va_list args;
 	char outMsg[5000];
-	std::string toWrite;
+	int length;
+	bool write = writable(module , logsev, type );
+	LoggerContext * context = write ? NULL : deferContext( type );
+
+	// Only format the message if it is going to be used
+	if( !write && NULL == context )
+		return;
 	va_start( args, message );
-	vsnprintf( outMsg , 5000, message.c_str() , args );
+	length = vsnprintf( outMsg , 5000, message.data() , args );
 	va_end( args );
-	message = outMsg;
+	if( length < 0 )
+		length = 0;
+	else if( length >= 5000 )
+		length = 5000 - 1;
+
 	try{
-		if( writable(module , logsev, type ) )
-			write( message , module , type );
+		if( write )
+			Logger::write( LoggerStringView( outMsg, length ) , module , type );
+		else
+			defer( LoggerStringView( outMsg, length ) , module , type, context );
 	}catch( LoggerExpFileError &e ){
 		cerr << e.what();
 	}
 }
 #ifdef USE_BOOST_INSTEAD_CXX11
-boost::shared_ptr<LoggerTemporaryStream> Logger::log( std::string module , int logsev, int type)
+boost::shared_ptr<LoggerTemporaryStream> Logger::log( LoggerStringView module , int logsev, int type)
 #else
-std::unique_ptr<LoggerTemporaryStream> Logger::log( std::string module , int logsev, int type)
+std::unique_ptr<LoggerTemporaryStream> Logger::log( LoggerStringView module , int logsev, int type)
 #endif
 {
+	LoggerContext * context;
+
+	// Streams write through the logger, that uses the output with the mutex
+	// locked, the file is only written directly by the streams without logger
 	if( writable(module, logsev, type)){
+		context = ( M_LOG_ERR == type ) ? LoggerContext::current( this ) : NULL;
+#ifdef USE_BOOST_INSTEAD_CXX11
+		boost::shared_ptr<LoggerTemporaryStream> p(new LoggerTemporaryStream(myfile, module, M_LOG_TRANSLATE[type].c_str(), &mutex, context) );
+#else
+		std::unique_ptr<LoggerTemporaryStream> p(new LoggerTemporaryStream(myfile, module, M_LOG_TRANSLATE[type].c_str(), &mutex, context, false,
+				this) );
+#endif
+		return p;
+	}else if( NULL != (context = deferContext( type )) ){
 #ifdef USE_BOOST_INSTEAD_CXX11
-		boost::shared_ptr<LoggerTemporaryStream> p(new LoggerTemporaryStream(myfile, module, M_LOG_TRANSLATE[type], &mutex) );
+		boost::shared_ptr<LoggerTemporaryStream> p(new LoggerTemporaryStream(myfile, module, M_LOG_TRANSLATE[type].c_str(), &mutex, context, true) );
 #else
-		std::unique_ptr<LoggerTemporaryStream> p(new LoggerTemporaryStream(myfile, module, M_LOG_TRANSLATE[type], &mutex) );
+		std::unique_ptr<LoggerTemporaryStream> p(new LoggerTemporaryStream(myfile, module, M_LOG_TRANSLATE[type].c_str(), &mutex, context, true,
+				this) );
 #endif
 		return p;
 	}else{
@@ -218,84 +1315,351 @@ std::unique_ptr<LoggerTemporaryStream> Logger::log( std::string module , int log
 		return p;
 	}
 }
-bool Logger::writable( std::string module , int logsev, int type )
+#ifndef USE_BOOST_INSTEAD_CXX11
+void Logger::log( LoggerCallSite & site, LoggerStringView message )
 {
-	LogModules::iterator it;
-	LogType::iterator it1,itl1;
+	LoggerContext * context;
+
+	try{
+		if( writable( site ) )
+			write( message , site.module , site.type, &site );
+		else if( M_LOG_SITE_OFF != site.getState() && NULL != (context = deferContext( site.type )) )
+			defer( message , site.module , site.type, context, &site );
+	}catch( LoggerExpFileError &e ){
+		cerr << e.what();
+	}
+}
+void Logger::logFormat( LoggerCallSite & site, const char * format, ...)
+{
+	va_list args;
+	char outMsg[5000];
+	int length;
+	bool write = writable( site );
+	LoggerContext * context = ( write || M_LOG_SITE_OFF == site.getState() ) ? NULL : deferContext( site.type );
+
+	// Only format the message if it is going to be used
+	if( !write && NULL == context )
+		return;
+	va_start( args, format );
+	length = vsnprintf( outMsg , 5000, format , args );
+	va_end( args );
+	if( length < 0 )
+		length = 0;
+	else if( length >= 5000 )
+		length = 5000 - 1;
+
+	try{
+		if( write )
+			Logger::write( LoggerStringView( outMsg, length ) , site.module , site.type, &site );
+		else
+			defer( LoggerStringView( outMsg, length ) , site.module , site.type, context, &site );
+	}catch( LoggerExpFileError &e ){
+		cerr << e.what();
+	}
+}
+std::unique_ptr<LoggerTemporaryStream> Logger::log( LoggerCallSite & site )
+{
+	LoggerContext * context;
 
-	bool writable = true;
+	if( writable( site ) ){
+		context = ( M_LOG_ERR == site.type ) ? LoggerContext::current( this ) : NULL;
+		return std::unique_ptr<LoggerTemporaryStream>(new LoggerTemporaryStream(myfile, site.module, M_LOG_TRANSLATE[site.type].c_str(), &mutex, context, false,
+				this, &site) );
+	}else if( M_LOG_SITE_OFF != site.getState() && NULL != (context = deferContext( site.type )) ){
+		return std::unique_ptr<LoggerTemporaryStream>(new LoggerTemporaryStream(myfile, site.module, M_LOG_TRANSLATE[site.type].c_str(), &mutex, context, true,
+				this, &site) );
+	}
+	return std::unique_ptr<LoggerTemporaryStream>(new LoggerTemporaryStream(myfile, "-1", "-1", &mutex) );
+}
+bool Logger::writable( LoggerCallSite & site )
+{
+	switch( site.getState() ){
+	case M_LOG_SITE_ON:
+		return true;
+	case M_LOG_SITE_OFF:
+		return false;
+	default:
+		return writable( site.module, site.logsev, site.type );
+	}
+}
+#endif
+bool Logger::writable( LoggerStringView module , int logsev, int type )
+{
 	int actType;
-	it = logLvls.find(module);
+#ifdef USE_BOOST_INSTEAD_CXX11
+	const LoggerModuleTree * tree = levels;
+#else
+	LoggerReaders::Guard guard( readers );
+	const LoggerModuleTree * tree = levels.load();
+#endif
 
-	if( type > M_LOG_LASTTYPE )
+	if( type >= M_LOG_LASTTYPE )
 		actType = M_LOG_LASTTYPE - 1;
 	else if( type <= M_LOG_NULLTYPE )
 		actType = M_LOG_NULLTYPE + 1;
 	else
 		actType = type;
 
-	//No specific configuration for the module
-	// Assumption: M_LOG_ALL_LVL is always set'ed with the log level by default
-	if( logLvls.end() == it ){
-		//cout << "No cfg for module" << endl;
-		//cout <<"No cfg for module:"<< logLvls[CONST_DEFMODULE][M_LOG_ALLLVL] << ">" <<logsev<< endl;
-		if(  logLvls[CONST_DEFMODULE][M_LOG_ALLLVL] > logsev )
-			writable = false;
-	}else{
-		it1 = logLvls[module].find(actType);
-		//There is no configuration for the log level
-		if( logLvls[module].end() == it1 )
-		{
-			//cout << "not cfg for log level" << endl;
-			itl1 = logLvls[module].find(M_LOG_ALLLVL);
-			// No configuration in this module for ALL levels
-			if( logLvls[module].end() == itl1 ){
-				//Assumption M_LOG_ALLLVL is always set'ed with the log level by default
-				//cout <<"Mod exist but no cfg for lvl, getting default"<< logLvls[CONST_DEFMODULE][M_LOG_ALLLVL] << ">" <<logsev<< endl;
-				if( logLvls[CONST_DEFMODULE][M_LOG_ALLLVL] > logsev )
-					writable = false;
-				// Configuration for all levels found
-			}else if( logLvls[module][M_LOG_ALLLVL] > logsev )
-				writable = false;
-			//cout <<"Mod exist but no cfg for lvl, getting default of module"<< logLvls[module][M_LOG_ALLLVL] << ">" <<logsev<< endl;
-		}else//There is a configuration for the log level
-		{
-			//cout <<"Has cfg for mode/type:"<< logLvls[module][actType] << ">" <<logsev<< endl;
-			if( logLvls[module][actType] > logsev )
-			{
-				//cout << "actlvl < logsev" << endl;
-				writable = false;
-			}
-		}
-
-	}
-	//cout << (writable?"writing":"Not writing") << endl;
-	return writable;
+	// The tree already resolved the module, its parents and the default module
+	return tree->find( module.data(), module.size() )[actType] <= logsev;
 }
-int Logger::write( std::string message, std::string module , int type ){
-	//writeLineStart(module, type);
+int Logger::write( LoggerStringView message, LoggerStringView module , int type, const LoggerCallSite * site ){
 	debugFun( "writing:[" << module << "][" << type <<  "]" << message<<endl);
 
-	//myfile << message << endl;
-	//myfile.flush();
+#ifndef USE_BOOST_INSTEAD_CXX11
+	LoggerDedupTable * table = dedup.load( std::memory_order_acquire );
+	if( NULL != table ){
+		LoggerDedupTable::Repeated repeated;
+		int window;
+		{
+			LoggerReaders::Guard guard( readers );
+			window = levels.load()->findWindow( module.data(), module.size() );
+		}
+		// The end of a window is noticed by the next log of the logger
+		if( table->expired() )
+			drainRepeated( false );
+		if( 0 != window ){
+			if( !table->check( module, type, message, window, repeated ) )
+				return 0;
+			if( 0 != repeated.count )
+				writeRepeated( repeated.module, repeated.type, repeated.message, repeated.count );
+		}
+	}
+#endif
 
+	// An error flushes what was kept by the context of the thread
+	return writeLine( message, module, type, ( M_LOG_ERR == type ) ? LoggerContext::current( this ) : NULL, site );
+}
+int Logger::writeLine( LoggerStringView message, LoggerStringView module , int type, LoggerContext * context,
+		const LoggerCallSite * site, const LoggerBinary * payload ){
 #ifdef USE_BOOST_INSTEAD_CXX11
-	boost::shared_ptr<LoggerTemporaryStream> p(new LoggerTemporaryStream(myfile, module, M_LOG_TRANSLATE[type], &mutex) );
-	p << message  << std::endl;
+	std::lock_guard<std::mutex*> lock(&mutex);
+	if( NULL != context ){
+		std::string kept;
+		context->flush( kept, module, M_LOG_TRANSLATE[type].c_str() );
+		output->write( kept.data(), kept.size() );
+	}
+	LoggerTemporaryStream::writeLineStart( *output, module, M_LOG_TRANSLATE[type].c_str() );
+	output->write( message.data(), message.size() );
+	if( NULL != payload )
+		*output << *payload;
+	output->put( '\n' );
+	output->flush();
 #else
-	LoggerTemporaryStream(myfile, module, M_LOG_TRANSLATE[type], &mutex) << message << endl;
+	// The line is formatted before the mutex is locked
+	std::string fallback;
+	std::string & line = threadLine( context, module, M_LOG_TRANSLATE[type].c_str(), fallback );
+	size_t start = line.size();
+	formatLog( line, message, module, M_LOG_TRANSLATE[type].c_str(), site, payload );
+	commitLine( line, start, module, M_LOG_TRANSLATE[type].c_str() );
 #endif
-
-
 	return 0;
 }
-int Logger::write(std::string message){
+#ifndef USE_BOOST_INSTEAD_CXX11
+namespace jpCppLibs{
+/**
+ * Log of a thread waiting to be written when combining
+ */
+struct LoggerCombineSlot{
+	/**
+	 * Formatted log, with the new line
+	 */
+	std::string line;
+	/**
+	 * Indicates that the log was written
+	 */
+	std::atomic<bool> done;
+	/**
+	 * Next log waiting, older than this one
+	 */
+	LoggerCombineSlot * next;
+	/**
+	 * Class constructor, the line starts big enough
+	 * for most logs so it rarely grows
+	 */
+	LoggerCombineSlot(){
+		line.reserve( 512 );
+	};
+};
+}
+/**
+ * Number of times a thread tries to get the mutex
+ * when combining before it waits for it
+ */
+static const int COMBINE_SPINS = 16;
+/**
+ * Slot of the current thread, NULL until its first log
+ */
+static thread_local LoggerCombineSlot * threadSlot = NULL;
+/**
+ * Indicates that the slot of the current thread was deleted,
+ * the thread can still log, for example in static destructors
+ */
+static thread_local bool threadSlotDeleted = false;
+/**
+ * Deletes the slot of the thread when it ends. The slot is
+ * only a pointer so it can still be checked after that
+ */
+struct LoggerCombineSlotOwner{
+	~LoggerCombineSlotOwner(){
+		delete threadSlot;
+		threadSlot = NULL;
+		threadSlotDeleted = true;
+	};
+};
+/**
+ * Retrieve the slot of the current thread, a thread only
+ * waits for one log at a time so it is shared by all loggers
+ * @return The slot or NULL if the thread is ending
+ */
+static LoggerCombineSlot *
+combineSlot(){
+	if( NULL == threadSlot && !threadSlotDeleted ){
+		static thread_local LoggerCombineSlotOwner owner;
+		threadSlot = new LoggerCombineSlot();
+	}
+	return threadSlot;
+}
+
+int
+Logger::setCombining( bool combine ){
+	combining.store( combine );
+	return 0;
+}
+
+int
+Logger::setPattern( std::string pattern ){
+	LoggerLayout * compiled = LoggerLayout::compile( pattern );
+	if( NULL == compiled )
+		return -1;
+	std::lock_guard<std::mutex> lock(mutex);
+	oldLayouts.push_back( layout.exchange( compiled ) );
+	// Other threads may still be formatting with the old layouts
+	if( readers->idle() ){
+		for( size_t i = 0 ; i < oldLayouts.size() ; i++ )
+			delete oldLayouts[i];
+		oldLayouts.clear();
+	}
+	return 0;
+}
+
+std::string &
+Logger::threadLine( LoggerContext * context, LoggerStringView module, const char * type, std::string & fallback ){
+	LoggerCombineSlot * slot = combineSlot();
+	std::string & line = ( NULL != slot ) ? slot->line : fallback;
+	LoggerTail * subscribers;
+	size_t notice;
+
+	line.clear();
+	if( NULL != context ){
+		notice = context->flush( line, module, type );
+		// The logs kept were not writable so only the logs dropped are published
+		if( notice < line.size() && NULL != (subscribers = tail.load( std::memory_order_acquire )) )
+			subscribers->publish( module, type, LoggerStringView( line.data() + notice, line.size() - notice ) );
+	}
+	return line;
+}
+
+void
+Logger::formatLog( std::string & out, LoggerStringView message, LoggerStringView module,
+		const char * type, const LoggerCallSite * site, const LoggerBinary * payload ) const{
+	LoggerReaders::Guard guard( readers );
+	LoggerTemporaryStream::formatLine( out, layout.load(), message, module, type, site, payload );
+}
+
+int
+Logger::setTailSocket( std::string path, size_t slots ){
+	LoggerTail * created, * expected = NULL;
+	// Checked first, a second socket in the same path would remove the first one
+	if( NULL != tail.load() )
+		return -1;
+	created = new LoggerTail( path, slots );
+	if( !tail.compare_exchange_strong( expected, created ) ){
+		delete created;
+		return -1;
+	}
+	return 0;
+}
+
+void
+Logger::commitLine( const std::string & line, size_t start, LoggerStringView module, const char * type ){
+	LoggerCombineSlot * slot = combineSlot(), * batch, * ordered, * next;
+	LoggerTail * subscribers = tail.load( std::memory_order_acquire );
+	int spins;
+
+	// The logs kept by the context have their own module and type
+	if( NULL != subscribers )
+		subscribers->publish( module, type, LoggerStringView( line.data() + start, line.size() - start ) );
+	// Without a slot the line is the fallback of a thread that is ending
+	if( !combining.load( std::memory_order_relaxed ) || NULL == slot || &slot->line != &line ){
+		std::lock_guard<std::mutex> lock(mutex);
+		output->write( line.data(), line.size() );
+		output->flush();
+		return;
+	}
+	slot->done.store( false, std::memory_order_relaxed );
+	slot->next = combinePending.load( std::memory_order_relaxed );
+	while( !combinePending.compare_exchange_weak( slot->next, slot,
+			std::memory_order_release, std::memory_order_relaxed ) );
+	// The thread that gets the mutex writes the logs of every thread waiting
+	for( spins = 0 ; !slot->done.load( std::memory_order_acquire ) ; spins++ ){
+		// After a few tries the thread sleeps in the mutex instead of spinning
+		if( spins >= COMBINE_SPINS )
+			mutex.lock();
+		else if( !mutex.try_lock() ){
+			std::this_thread::yield();
+			continue;
+		}
+		batch = combinePending.exchange( NULL, std::memory_order_acquire );
+		for( ordered = NULL ; NULL != batch ; batch = next ){
+			next = batch->next;
+			batch->next = ordered;
+			ordered = batch;
+		}
+		// The log was written by the thread that had the mutex before
+		if( NULL == ordered ){
+			mutex.unlock();
+			continue;
+		}
+		for( batch = ordered ; NULL != batch ; batch = batch->next )
+			output->write( batch->line.data(), batch->line.size() );
+		output->flush();
+		// Once done is set the slot can be reused by its thread
+		for( batch = ordered ; NULL != batch ; batch = next ){
+			next = batch->next;
+			batch->done.store( true, std::memory_order_release );
+		}
+		mutex.unlock();
+	}
+}
+#endif
+int Logger::defer( LoggerStringView message, LoggerStringView module , int type, LoggerContext * context,
+		const LoggerCallSite * site, const LoggerBinary * payload ){
+	debugFun( "deferring:[" << module << "][" << type <<  "]" << message<<endl);
+#ifdef USE_BOOST_INSTEAD_CXX11
+	std::string line;
+	LoggerTemporaryStream::formatLine( line, NULL, message, module, M_LOG_TRANSLATE[type].c_str(), site, payload );
+#else
+	std::string fallback;
+	std::string & line = threadLine( NULL, module, M_LOG_TRANSLATE[type].c_str(), fallback );
+	formatLog( line, message, module, M_LOG_TRANSLATE[type].c_str(), site, payload );
+#endif
+	context->keep( line );
+	return 0;
+}
+LoggerContext *
+Logger::deferContext( int type ){
+	if( M_LOG_TRC != type && M_LOG_DBG != type )
+		return NULL;
+	return LoggerContext::current( this );
+}
+int Logger::write(std::string message){
 
 	debugFun( "writing:[" << message<<endl);
 
-	myfile.setf(std::ios::left);
-	myfile << message;
-	myfile.flush();
+	output->setf(std::ios::left);
+	*output << message;
+	output->flush();
 
 	return 0;
 }
@@ -314,6 +1678,8 @@ Logger::setLoggerLevel( const LogModules lvls){
 	debugFun( "Set new log level");
 	Logger::logLvls.clear();
 	Logger::logLvls = (LogModules)lvls;
+	buildLevels();
+	return 0;
 }
 
 /**
@@ -325,22 +1691,814 @@ int
 Logger::copyLoggerDef( Logger * logger ){
 	//cout << "copyLoggerDef"<<endl;
 	debugFun( "Copying the logger[");
-	try{
-		setFile(logger->getFile());
-	}catch( LoggerExpFileError &e ){
-		cerr << e.what()<< endl;
+	// Two loggers can not share a compressed or indexed file
+	if( NULL == logger->sink ){
+		try{
+			setFile(logger->getFile());
+		}catch( LoggerExpFileError &e ){
+			cerr << e.what()<< endl;
+		}
 	}
 	//cout << "going out"<<endl;
 	return setLoggerLevel( logger->getLogLvls() );
 
 }
 
+JPLOGGER_THREAD_LOCAL LoggerContext * LoggerContext::active = NULL;
+
+LoggerContext::LoggerContext( Logger * logger, std::string name, size_t maxBuffered ):
+		logger(logger),
+		name(name),
+		maxBuffered(maxBuffered),
+		dropped(0),
+		previous(active){
+	active = this;
+}
+LoggerContext::~LoggerContext(){
+	// Contexts are scoped so the innermost one is always the first to end
+	active = previous;
+}
+
+LoggerContext *
+LoggerContext::current( const Logger * logger ){
+	LoggerContext * context;
+	for( context = active ; NULL != context ; context = context->previous )
+		if( context->logger == logger )
+			return context;
+	return NULL;
+}
+const std::string &
+LoggerContext::getName() const{
+	return name;
+}
+size_t
+LoggerContext::getBufferedSize() const{
+	return buffer.size();
+}
+void
+LoggerContext::keep( const std::string & line ){
+	if( buffer.size() + line.size() > maxBuffered ){
+		dropped++;
+		return;
+	}
+	buffer += line;
+}
+size_t
+LoggerContext::flush( std::string & out, LoggerStringView module, const char * type ){
+	size_t notice;
+	char count[32];
+	std::string text;
+
+	out += buffer;
+	notice = out.size();
+	if( 0 != dropped ){
+		// Written like any other log so the tools can filter it
+		text = "Context " + name + " dropped ";
+		text.append( count, snprintf( count, sizeof(count), "%lu logs", (unsigned long)dropped ) );
 #ifdef USE_BOOST_INSTEAD_CXX11
-boost::shared_ptr<Logger> OneInstanceLogger::inst(new Logger());
+		LoggerTemporaryStream::formatLine( out, NULL, text, module, type, NULL );
 #else
-std::unique_ptr<Logger> OneInstanceLogger::inst = nullptr;
+		logger->formatLog( out, text, module, type );
 #endif
+	}
+	buffer.clear();
+	dropped = 0;
+	return notice;
+}
+
+#ifndef USE_BOOST_INSTEAD_CXX11
+/**
+ * Rule applied to the call sites
+ */
+struct LoggerCallSiteRule{
+	std::string pattern;
+	int state;
+};
+/**
+ * Mutex that protects the registry of call sites
+ * It is created on first use so it can be used during static initialization
+ */
+static std::mutex &
+callSitesMutex(){
+	static std::mutex m;
+	return m;
+}
+/**
+ * Rules applied to the call sites, in the order they were set
+ */
+static std::vector<LoggerCallSiteRule> &
+callSitesRules(){
+	static std::vector<LoggerCallSiteRule> rules;
+	return rules;
+}
+/**
+ * First call site registered
+ */
+static LoggerCallSite * callSitesHead = NULL;
+
+/**
+ * Match a string against a pattern with * and ?
+ * @param pattern Pattern
+ * @param str String to match
+ * @return True if it matches
+ */
+static bool
+globMatch( const char * pattern, const char * str ){
+	const char * star = NULL, * starStr = NULL;
+	while( '\0' != *str ){
+		if( '*' == *pattern ){
+			star = pattern++;
+			starStr = str;
+		}else if( '?' == *pattern || *pattern == *str ){
+			pattern++;
+			str++;
+		}else if( NULL != star ){
+			pattern = star + 1;
+			str = ++starStr;
+		}else
+			return false;
+	}
+	while( '*' == *pattern )
+		pattern++;
+	return '\0' == *pattern;
+}
+
+bool
+LoggerCallSite::matches( const std::string & pattern ) const{
+	std::ostringstream fileLine;
+	fileLine << file << ":" << line;
+	return globMatch( pattern.c_str(), file ) ||
+			globMatch( pattern.c_str(), fileLine.str().c_str() ) ||
+			globMatch( pattern.c_str(), module );
+}
+int
+LoggerCallSite::getState(){
+	int state = flag.load(std::memory_order_acquire);
+	if( M_LOG_SITE_NEW != state )
+		return state;
+	std::lock_guard<std::mutex> lock(callSitesMutex());
+	state = flag.load(std::memory_order_relaxed);
+	if( M_LOG_SITE_NEW != state )
+		return state;
+	state = M_LOG_SITE_DEFAULT;
+	std::vector<LoggerCallSiteRule> & rules = callSitesRules();
+	for( std::vector<LoggerCallSiteRule>::iterator it = rules.begin(); it != rules.end(); ++it )
+		if( matches( it->pattern ) )
+			state = it->state;
+	next = callSitesHead;
+	callSitesHead = this;
+	flag.store(state, std::memory_order_release);
+	return state;
+}
+int
+LoggerCallSite::setCallSites( const std::string & pattern, int state ){
+	LoggerCallSiteRule rule;
+	LoggerCallSite * site;
+	int changed = 0;
+	if( M_LOG_SITE_DEFAULT != state && M_LOG_SITE_ON != state && M_LOG_SITE_OFF != state )
+		return -1;
+	std::lock_guard<std::mutex> lock(callSitesMutex());
+	// A rule for all the call sites replaces the previous ones
+	if( 0 == pattern.compare("*") )
+		callSitesRules().clear();
+	rule.pattern = pattern;
+	rule.state = state;
+	callSitesRules().push_back(rule);
+	for( site = callSitesHead; NULL != site; site = site->next ){
+		if( site->matches( pattern ) ){
+			site->flag.store(state, std::memory_order_relaxed);
+			changed++;
+		}
+	}
+	return changed;
+}
+std::vector<const LoggerCallSite*>
+LoggerCallSite::getCallSites(){
+	std::vector<const LoggerCallSite*> result;
+	std::lock_guard<std::mutex> lock(callSitesMutex());
+	for( LoggerCallSite * site = callSitesHead; NULL != site; site = site->next )
+		result.push_back(site);
+	return result;
+}
+#endif
+
+void
+LoggerTemporaryStream::writeLineStart( std::ostream & out, LoggerStringView module, const char * type ){
+	size_t i;
+	out.write( formatDate( time(NULL) ), 19 );
+	out.put( ' ' );
+	// Modules are padded to 6 characters to align the types
+	for( i = module.size() ; i < 6 ; i++ )
+		out.put( ' ' );
+	out << module << '[' << type << ']' << '\t';
+}
+void
+LoggerTemporaryStream::writeLineStart( std::string & out, LoggerStringView module, const char * type ){
+	out.append( formatDate( time(NULL) ), 19 ).push_back( ' ' );
+	// Modules are padded to 6 characters to align the types
+	if( module.size() < 6 )
+		out.append( 6 - module.size(), ' ' );
+	out.append( module.data(), module.size() ).append( 1, '[' ).append( type ).append( "]\t" );
+}
+void
+LoggerTemporaryStream::formatLine( std::string & out, const LoggerLayout * layout, LoggerStringView message,
+		LoggerStringView module, const char * type, const LoggerCallSite * site, const LoggerBinary * payload ){
+#ifndef USE_BOOST_INSTEAD_CXX11
+	if( NULL != layout ){
+		layout->format( out, message, module, type, site, payload );
+		return;
+	}
+#endif
+	writeLineStart( out, module, type );
+	out.append( message.data(), message.size() );
+	if( NULL != payload )
+		payload->encode( out );
+	out.push_back( '\n' );
+}
+
+/**
+ * Digits of the encodings
+ */
+static const char HEX_DIGITS[] = "0123456789abcdef";
+static const char BASE64_DIGITS[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+/**
+ * Move the 4 lower bytes of a word to its even bytes
+ * @param value Word
+ * @return The bytes spread
+ */
+static inline uint64_t
+spreadBytes( uint64_t value ){
+	value = ( value | ( value << 16 ) ) & 0x0000FFFF0000FFFFULL;
+	return ( value | ( value << 8 ) ) & 0x00FF00FF00FF00FFULL;
+}
+
+/**
+ * Convert the 8 bytes of a word, each from 0 to 15, to hex digits
+ * @param nibbles Word
+ * @return The digits
+ */
+static inline uint64_t
+hexDigits( uint64_t nibbles ){
+	// 1 in the bytes of 10 or more, they go from '0' + 10 to 'a'
+	uint64_t letters = ( ( nibbles + 0x0606060606060606ULL ) >> 4 ) & 0x0101010101010101ULL;
+	return nibbles + 0x3030303030303030ULL + letters * ( 'a' - '0' - 10 );
+}
+#endif
+
+/**
+ * Encode bytes in hex
+ * @param bytes Bytes
+ * @param length Number of bytes
+ * @param out Buffer for twice the number of bytes
+ */
+static void
+encodeHex( const unsigned char * bytes, size_t length, char * out ){
+	size_t i = 0;
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+	uint64_t word, high, low, digits;
+	// 8 bytes at a time in a word, the high digit of each byte goes first
+	for( ; i + 8 <= length ; i += 8 ){
+		memcpy( &word, bytes + i, sizeof(word) );
+		high = ( word >> 4 ) & 0x0F0F0F0F0F0F0F0FULL;
+		low = word & 0x0F0F0F0F0F0F0F0FULL;
+		digits = hexDigits( spreadBytes( high & 0xFFFFFFFF ) | ( spreadBytes( low & 0xFFFFFFFF ) << 8 ) );
+		memcpy( out + 2 * i, &digits, sizeof(digits) );
+		digits = hexDigits( spreadBytes( high >> 32 ) | ( spreadBytes( low >> 32 ) << 8 ) );
+		memcpy( out + 2 * i + 8, &digits, sizeof(digits) );
+	}
+#endif
+	for( ; i < length ; i++ ){
+		out[2 * i] = HEX_DIGITS[bytes[i] >> 4];
+		out[2 * i + 1] = HEX_DIGITS[bytes[i] & 0xF];
+	}
+}
+
+/**
+ * Encode bytes in base64
+ * @param bytes Bytes
+ * @param length Number of bytes
+ * @param out Buffer for 4 characters for each 3 bytes, rounded up
+ */
+static void
+encodeBase64( const unsigned char * bytes, size_t length, char * out ){
+	uint32_t value;
+	size_t i;
+
+	for( i = 0 ; i + 3 <= length ; i += 3, out += 4 ){
+		value = ( bytes[i] << 16 ) | ( bytes[i + 1] << 8 ) | bytes[i + 2];
+		out[0] = BASE64_DIGITS[value >> 18];
+		out[1] = BASE64_DIGITS[( value >> 12 ) & 0x3F];
+		out[2] = BASE64_DIGITS[( value >> 6 ) & 0x3F];
+		out[3] = BASE64_DIGITS[value & 0x3F];
+	}
+	if( i == length )
+		return;
+	value = ( bytes[i] << 16 ) | ( ( i + 1 < length ) ? bytes[i + 1] << 8 : 0 );
+	out[0] = BASE64_DIGITS[value >> 18];
+	out[1] = BASE64_DIGITS[( value >> 12 ) & 0x3F];
+	out[2] = ( i + 1 < length ) ? BASE64_DIGITS[( value >> 6 ) & 0x3F] : '=';
+	out[3] = '=';
+}
+
+/**
+ * Number of bytes of a payload encoded at a time
+ * when it is written to a stream, multiple of 3
+ */
+static const size_t BINARY_PIECE = 48;
+
+const size_t LoggerBinary::TRUNCATED_LENGTH;
+
+size_t
+LoggerBinary::truncated( char * out ) const{
+	if( length <= maxLength )
+		return 0;
+	return std::min( (size_t)snprintf( out, TRUNCATED_LENGTH, "...(truncated, %lu of %lu bytes)",
+			(unsigned long)maxLength, (unsigned long)length ), TRUNCATED_LENGTH - 1 );
+}
+
+size_t
+LoggerBinary::encodedSize() const{
+	size_t count = std::min( length, maxLength );
+	char text[TRUNCATED_LENGTH];
+	return ( ( M_LOG_BASE64 == encoding ) ? ( count + 2 ) / 3 * 4 : 2 * count ) + truncated( text );
+}
+
+size_t
+LoggerBinary::encode( char * out ) const{
+	size_t count = std::min( length, maxLength ), size;
+	char text[TRUNCATED_LENGTH];
+
+	if( M_LOG_BASE64 == encoding ){
+		encodeBase64( bytes, count, out );
+		size = ( count + 2 ) / 3 * 4;
+	}else{
+		encodeHex( bytes, count, out );
+		size = 2 * count;
+	}
+	count = truncated( text );
+	memcpy( out + size, text, count );
+	return size + count;
+}
+
+void
+LoggerBinary::encode( std::string & out ) const{
+	size_t start = out.size();
+
+	// Encoded straight into the string
+	out.resize( start + encodedSize() );
+	out.resize( start + encode( &out[start] ) );
+}
+
+namespace jpCppLibs{
+std::ostream &
+operator<<( std::ostream & os, const LoggerBinary & payload ){
+	LoggerTemporaryStream * stream = dynamic_cast<LoggerTemporaryStream *>( &os );
+	size_t count = std::min( payload.length, payload.maxLength );
+	char encoded[2 * BINARY_PIECE];
+
+	if( NULL != stream ){
+		stream->buffer.writePayload( payload );
+		return os;
+	}
+	// Other streams receive the payload in pieces
+	for( size_t i = 0 ; i < count ; i += BINARY_PIECE )
+		os.write( encoded, LoggerBinary( payload.bytes + i, std::min( BINARY_PIECE, count - i ),
+				payload.encoding, BINARY_PIECE ).encode( encoded ) );
+	return os.write( encoded, payload.truncated( encoded ) );
+}
+}
+
+#ifndef USE_BOOST_INSTEAD_CXX11
+namespace jpCppLibs{
+/**
+ * Pool of memory blocks of the same size for the records of the logs.
+ * Each thread takes and gives back blocks to its own list without locks,
+ * when the list grows too much a batch of blocks goes back to the pool,
+ * so the blocks freed by a thread reach the threads that need them
+ */
+template<size_t SIZE>
+class LoggerBlockPool{
+public:
+	/**
+	 * Take a block
+	 * @return The block
+	 */
+	static void * allocate();
+	/**
+	 * Give back a block
+	 * @param memory The block
+	 */
+	static void release( void * memory );
+private:
+	/**
+	 * Free block, the first block of a batch in the pool
+	 * also links to the next batch
+	 */
+	struct Block{
+		Block * next;
+		Block * nextBatch;
+		size_t batchCount;
+	};
+	/**
+	 * List of free blocks
+	 */
+	struct List{
+		Block * head;
+		size_t count;
+	};
+	/**
+	 * Free blocks of a thread, a plain structure that is
+	 * still valid after the storage of the thread ends
+	 */
+	struct Cache{
+		List free;
+		/**
+		 * Indicates that the owner was created
+		 */
+		bool owned;
+		/**
+		 * Indicates that the storage of the thread ended, the
+		 * thread can still log, for example in static destructors
+		 */
+		bool ended;
+	};
+	/**
+	 * Gives back the free blocks of a thread to the pool when the thread ends
+	 */
+	struct Owner{
+		Cache * blocks;
+		~Owner();
+	};
+	/**
+	 * Batches of free blocks shared by the threads
+	 */
+	struct Shared{
+		std::mutex mutex;
+		Block * batches;
+		Shared(): batches(NULL){};
+		/**
+		 * Add a batch, the mutex must be locked
+		 * @param batch Blocks of the batch
+		 */
+		void push( const List & batch ){
+			batch.head->nextBatch = batches;
+			batch.head->batchCount = batch.count;
+			batches = batch.head;
+		};
+	};
+	/**
+	 * Number of blocks moved at a time between a thread and the pool
+	 */
+	static const size_t BATCH = 32;
+	/**
+	 * Number of bytes allocated for each block
+	 */
+	static const size_t BLOCK_BYTES = ( SIZE < sizeof(Block) ) ? sizeof(Block) : SIZE;
+	/**
+	 * Retrieve the free blocks of the current thread
+	 * @return The free blocks or NULL if the storage of the thread ended
+	 */
+	static Cache * cache(){
+		static thread_local Cache blocks;
+		if( !blocks.owned && !blocks.ended ){
+			static thread_local Owner owner = { &blocks };
+			blocks.owned = true;
+		}
+		return blocks.ended ? NULL : &blocks;
+	}
+	/**
+	 * Retrieve the batches shared by the threads, never deleted
+	 * so the threads can give back blocks until the process ends
+	 * @return The batches
+	 */
+	static Shared & shared(){
+		static Shared * batches = new Shared();
+		return *batches;
+	}
+};
+}
+
+template<size_t SIZE>
+LoggerBlockPool<SIZE>::Owner::~Owner(){
+	Shared & pool = shared();
+	std::lock_guard<std::mutex> lock(pool.mutex);
+	if( NULL != blocks->free.head )
+		pool.push( blocks->free );
+	blocks->free.head = NULL;
+	blocks->free.count = 0;
+	blocks->ended = true;
+}
+
+template<size_t SIZE>
+void *
+LoggerBlockPool<SIZE>::allocate(){
+	Cache * owned = cache();
+	Block * block;
+
+	if( NULL == owned )
+		return ::operator new( BLOCK_BYTES );
+	List & blocks = owned->free;
+	if( NULL == blocks.head ){
+		Shared & pool = shared();
+		std::lock_guard<std::mutex> lock(pool.mutex);
+		if( NULL != pool.batches ){
+			blocks.head = pool.batches;
+			blocks.count = pool.batches->batchCount;
+			pool.batches = pool.batches->nextBatch;
+		}
+	}
+	if( NULL == blocks.head )
+		return ::operator new( BLOCK_BYTES );
+	block = blocks.head;
+	blocks.head = block->next;
+	blocks.count--;
+	return block;
+}
+
+template<size_t SIZE>
+void
+LoggerBlockPool<SIZE>::release( void * memory ){
+	Cache * owned = cache();
+	Block * block = static_cast<Block *>( memory ), * last;
+	List batch;
+
+	// Blocks given back while the thread ends go to the heap
+	if( NULL == owned ){
+		::operator delete( memory );
+		return;
+	}
+	List & blocks = owned->free;
+	block->next = blocks.head;
+	blocks.head = block;
+	if( ++blocks.count < 2 * BATCH )
+		return;
+	// The newest blocks stay in the thread
+	for( last = blocks.head, batch.count = 1 ; batch.count < BATCH ; batch.count++ )
+		last = last->next;
+	batch.head = last->next;
+	batch.count = blocks.count - BATCH;
+	last->next = NULL;
+	blocks.count = BATCH;
+	Shared & pool = shared();
+	std::lock_guard<std::mutex> lock(pool.mutex);
+	pool.push( batch );
+}
+#endif
+
+const size_t LoggerTemporaryStream::TEXT_BLOCK;
+const size_t LoggerTemporaryStream::MODULE_IN_BLOCK;
+
+void *
+LoggerTemporaryStream::operator new( size_t size ){
+#ifndef USE_BOOST_INSTEAD_CXX11
+	// Classes derived from the stream have other sizes
+	if( sizeof(LoggerTemporaryStream) == size )
+		return LoggerBlockPool<sizeof(LoggerTemporaryStream)>::allocate();
+#endif
+	return ::operator new( size );
+}
+
+void
+LoggerTemporaryStream::operator delete( void * stream, size_t size ){
+#ifndef USE_BOOST_INSTEAD_CXX11
+	if( sizeof(LoggerTemporaryStream) == size ){
+		LoggerBlockPool<sizeof(LoggerTemporaryStream)>::release( stream );
+		return;
+	}
+#endif
+	::operator delete( stream );
+}
+
+LoggerTemporaryStream::LoggerTemporaryBuffer::LoggerTemporaryBuffer( std::ostream& str, LoggerStringView module,
+		const char * type, std::mutex *mutex, LoggerContext *context, bool deferred, Logger *writer,
+		const LoggerCallSite *site ):
+		output(str),
+		block(NULL),
+		module(NULL, 0),
+		messageStart(NULL),
+		type(type),
+		mutex(mutex),
+		context(context),
+		deferred(deferred),
+		writer(writer),
+		site(site){
+	// Discarded logs are not kept at all
+	if( module == "-1" )
+		return;
+#ifdef USE_BOOST_INSTEAD_CXX11
+	block = new char[TEXT_BLOCK];
+#else
+	block = static_cast<char *>( LoggerBlockPool<TEXT_BLOCK>::allocate() );
+#endif
+	if( module.size() <= MODULE_IN_BLOCK ){
+		memcpy( block, module.data(), module.size() );
+		this->module = LoggerStringView( block, module.size() );
+		messageStart = block + module.size();
+	}else{
+		longModule.assign( module.data(), module.size() );
+		this->module = longModule;
+		messageStart = block;
+	}
+	setp( messageStart, block + TEXT_BLOCK );
+}
+
+LoggerTemporaryStream::LoggerTemporaryBuffer::~LoggerTemporaryBuffer(){
+	if( NULL == block )
+		return;
+#ifdef USE_BOOST_INSTEAD_CXX11
+	delete[] block;
+#else
+	LoggerBlockPool<TEXT_BLOCK>::release( block );
+#endif
+}
+
+LoggerTemporaryStream::LoggerTemporaryBuffer::int_type
+LoggerTemporaryStream::LoggerTemporaryBuffer::overflow( int_type c ){
+	if( NULL == block || traits_type::eq_int_type( c, traits_type::eof() ) )
+		return traits_type::not_eof( c );
+	longMessage.append( pbase(), pptr() - pbase() );
+	longMessage.push_back( traits_type::to_char_type( c ) );
+	setp( messageStart, block + TEXT_BLOCK );
+	return c;
+}
+
+int
+LoggerTemporaryStream::LoggerTemporaryBuffer::sync(){
+	LoggerStringView text( pbase(), pptr() - pbase() );
+
+	if( NULL == block )
+		return 0;
+	if( !longMessage.empty() ){
+		longMessage.append( pbase(), pptr() - pbase() );
+		text = longMessage;
+	}
+	if( 0 != text.size() ){
+		// The new line of std::endl is written by the layout
+		LoggerStringView message( text.data(), text.size() - ( '\n' == text.data()[text.size() - 1] ? 1 : 0 ) );
+#ifndef USE_BOOST_INSTEAD_CXX11
+		std::string fallback;
+		if( NULL != writer && deferred ){
+			std::string & line = writer->threadLine( NULL, module, type, fallback );
+			writer->formatLog( line, message, module, type, site );
+			context->keep( line );
+		}else if( NULL != writer ){
+			std::string & line = writer->threadLine( context, module, type, fallback );
+			size_t start = line.size();
+			writer->formatLog( line, message, module, type, site );
+			writer->commitLine( line, start, module, type );
+		}else
+#endif
+		{
+			std::string line;
+			formatLine( line, NULL, message, module, type, site );
+			if( deferred ){
+				context->keep( line );
+			}else{
+#ifdef USE_BOOST_INSTEAD_CXX11
+				std::lock_guard<std::mutex*> lock(mutex);
+#else
+				std::lock_guard<std::mutex> lock(*mutex);
+#endif
+				if( NULL != context ){
+					std::string kept;
+					context->flush( kept, module, type );
+					output.write( kept.data(), kept.size() );
+				}
+				output.write( line.data(), line.size() );
+				output.flush();
+			}
+		}
+	}
+	longMessage.clear();
+	setp( messageStart, block + TEXT_BLOCK );
+	return 0;
+}
+
+void
+LoggerTemporaryStream::LoggerTemporaryBuffer::writePayload( const LoggerBinary & payload ){
+	size_t size;
+
+	// Discarded logs are not encoded
+	if( NULL == block )
+		return;
+	size = payload.encodedSize();
+	if( size <= (size_t)( epptr() - pptr() ) ){
+		pbump( payload.encode( pptr() ) );
+		return;
+	}
+	longMessage.append( pbase(), pptr() - pbase() );
+	setp( messageStart, block + TEXT_BLOCK );
+	payload.encode( longMessage );
+}
+
+#ifndef USE_BOOST_INSTEAD_CXX11
+/**
+ * Logger of the registry
+ */
+struct LoggerRegistryEntry{
+	/**
+	 * Hash of the name
+	 */
+	uint64_t hash;
+	/**
+	 * Name of the logger
+	 */
+	std::string name;
+	/**
+	 * Logger
+	 */
+	Logger logger;
+	/**
+	 * Next logger in the same bucket
+	 */
+	LoggerRegistryEntry * next;
+};
+/**
+ * Number of buckets of the registry, must be a power of 2
+ */
+static const size_t REGISTRY_BUCKETS = 64;
+/**
+ * Buckets of the registry, static storage is zeroed before
+ * any constructor runs so it is usable during static initialization
+ */
+static std::atomic<LoggerRegistryEntry *> registryBuckets[REGISTRY_BUCKETS];
+/**
+ * Size of the cache of each thread, must be a power of 2
+ */
+static const size_t REGISTRY_CACHE = 8;
+/**
+ * Loggers recently requested by the thread
+ */
+static JPLOGGER_THREAD_LOCAL LoggerRegistryEntry * registryCache[REGISTRY_CACHE];
+/**
+ * Indicates that the function called at exit was registered
+ */
+static std::atomic<bool> registryAtExit;
+
+/**
+ * Search a logger in a bucket
+ * @param entry First logger to check
+ * @param last Logger where the search stops
+ * @param hash Hash of the name
+ * @param name Name of the logger
+ * @return The logger or NULL if not found
+ */
+static LoggerRegistryEntry *
+registryFind( LoggerRegistryEntry * entry, LoggerRegistryEntry * last, uint64_t hash, LoggerStringView name ){
+	for( ; last != entry ; entry = entry->next )
+		if( hash == entry->hash && name == LoggerStringView( entry->name ) )
+			return entry;
+	return NULL;
+}
+
+Logger &
+LoggerRegistry::getLogger( LoggerStringView name ){
+	uint64_t hash = hashBytes( name.data(), name.size(), 0 );
+	LoggerRegistryEntry ** cached = &registryCache[hash & ( REGISTRY_CACHE - 1 )];
+	std::atomic<LoggerRegistryEntry *> & bucket = registryBuckets[( hash >> 8 ) & ( REGISTRY_BUCKETS - 1 )];
+	LoggerRegistryEntry * head, * found, * created = NULL, * searched = NULL;
+
+	if( NULL != *cached && hash == (*cached)->hash && name == LoggerStringView( (*cached)->name ) )
+		return (*cached)->logger;
+	head = bucket.load( std::memory_order_acquire );
+	found = registryFind( head, NULL, hash, name );
+	while( NULL == found ){
+		if( NULL == created ){
+			created = new LoggerRegistryEntry();
+			created->hash = hash;
+			created->name.assign( name.data(), name.size() );
+		}
+		created->next = head;
+		searched = head;
+		if( bucket.compare_exchange_weak( head, created, std::memory_order_acq_rel, std::memory_order_acquire ) ){
+			found = created;
+			created = NULL;
+			if( !registryAtExit.exchange( true ) )
+				atexit( &LoggerRegistry::atExit );
+		}else
+			// Other thread may have created the same logger meanwhile
+			found = registryFind( head, searched, hash, name );
+	}
+	delete created;
+	*cached = found;
+	return found->logger;
+}
+
+void
+LoggerRegistry::atExit(){
+	LoggerRegistryEntry * entry;
+	for( size_t i = 0 ; i < REGISTRY_BUCKETS ; i++ )
+		for( entry = registryBuckets[i].load( std::memory_order_acquire ) ; NULL != entry ; entry = entry->next )
+			entry->logger.finish();
+}
+#endif
+
+#ifdef USE_BOOST_INSTEAD_CXX11
+boost::shared_ptr<Logger> OneInstanceLogger::inst(new Logger());
 std::mutex OneInstanceLogger::m_mutex;
+#endif
 Logger &
 OneInstanceLogger::instance(){
 #ifdef USE_BOOST_INSTEAD_CXX11
@@ -349,13 +2507,8 @@ OneInstanceLogger::instance(){
 		if( NULL == inst )
 			inst.reset(new Logger());
 	}
+	return *inst.get();
 #else
-	if( nullptr == inst ){
-		std::lock_guard<std::mutex> lock(m_mutex);
-		if( nullptr == inst )
-			inst.reset(new Logger());
-	}
+	return LoggerRegistry::getLogger( "" );
 #endif
-	return *inst.get();
 };
-
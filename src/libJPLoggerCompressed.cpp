@@ -0,0 +1,282 @@
+#include "libJPLoggerCompressed.hpp"
+#ifndef USE_BOOST_INSTEAD_CXX11
+#include <string.h>
+#include <chrono>
+#ifdef JPLOGGER_WITH_ZLIB
+#include <zlib.h>
+#endif
+
+using namespace std;
+using namespace jpCppLibs;
+
+LoggerCompressedBuffer::LoggerCompressedBuffer( std::string filename, size_t blockSize, int maxDelay ):
+		complete(0),
+		blockSize(blockSize),
+		maxDelay( ( maxDelay > 0 ) ? maxDelay : 1 ),
+		writing(false),
+		stop(false),
+		offset(0){
+	current.first = current.last = 0;
+	data.open( filename.c_str(), ios::app | ios::binary );
+	index.open( (filename + ".idx").c_str(), ios::app );
+	if( !data.is_open() || !index.is_open() ){
+		cerr << "Log file:[" << filename <<
+				"] could not be opened" << endl;
+		throw LoggerExpFileError(true);
+	}
+	data.seekp( 0, ios::end );
+	offset = data.tellp();
+	worker = std::thread( &LoggerCompressedBuffer::run, this );
+}
+
+LoggerCompressedBuffer::~LoggerCompressedBuffer(){
+	{
+		std::lock_guard<std::mutex> lock(pendingMutex);
+		complete = current.data.size();
+		seal();
+		stop = true;
+	}
+	pendingCond.notify_one();
+	worker.join();
+}
+
+void
+LoggerCompressedBuffer::drain(){
+	std::unique_lock<std::mutex> lock(pendingMutex);
+	complete = current.data.size();
+	seal();
+	pendingCond.notify_one();
+	while( !pending.empty() || writing )
+		writtenCond.wait( lock );
+}
+
+LoggerCompressedBuffer::int_type
+LoggerCompressedBuffer::overflow( int_type c ){
+	if( traits_type::eq_int_type( c, traits_type::eof() ) )
+		return traits_type::not_eof( c );
+	std::lock_guard<std::mutex> lock(pendingMutex);
+	if( current.data.empty() )
+		current.first = time(NULL);
+	current.data.push_back( traits_type::to_char_type( c ) );
+	return c;
+}
+
+std::streamsize
+LoggerCompressedBuffer::xsputn( const char * s, std::streamsize n ){
+	std::lock_guard<std::mutex> lock(pendingMutex);
+	if( current.data.empty() )
+		current.first = time(NULL);
+	current.data.append( s, n );
+	return n;
+}
+
+int
+LoggerCompressedBuffer::sync(){
+	bool wake;
+	{
+		std::lock_guard<std::mutex> lock(pendingMutex);
+		// The logger flushes after each line so the block ends a line
+		current.last = time(NULL);
+		// The thread waits for the age of the first line of the block
+		wake = ( 0 == complete && !current.data.empty() );
+		complete = current.data.size();
+		if( complete >= blockSize ){
+			seal();
+			wake = true;
+		}
+	}
+	if( wake )
+		pendingCond.notify_one();
+	return 0;
+}
+
+void
+LoggerCompressedBuffer::seal(){
+	if( 0 == complete )
+		return;
+	pending.push_back( Block() );
+	Block & block = pending.back();
+	block.first = current.first;
+	block.last = ( 0 == current.last ) ? current.first : current.last;
+	if( complete == current.data.size() ){
+		block.data.swap( current.data );
+		current.data.reserve( blockSize + blockSize / 8 );
+	}else{
+		// The start of a line not yet ended stays for the next block
+		block.data.assign( current.data, 0, complete );
+		current.data.erase( 0, complete );
+		current.first = time(NULL);
+	}
+	complete = 0;
+	current.last = 0;
+}
+
+void
+LoggerCompressedBuffer::run(){
+	Block block;
+	time_t now;
+	for(;;){
+		{
+			std::unique_lock<std::mutex> lock(pendingMutex);
+			writing = false;
+			writtenCond.notify_all();
+			while( pending.empty() && !stop ){
+				now = time(NULL);
+				if( 0 == complete )
+					pendingCond.wait( lock );
+				else if( now - current.first >= maxDelay )
+					// A logger that writes little still gets its lines in the file
+					seal();
+				else
+					pendingCond.wait_for( lock, std::chrono::seconds( current.first + maxDelay - now ) );
+			}
+			if( pending.empty() )
+				return;
+			block.data.swap( pending.front().data );
+			block.first = pending.front().first;
+			block.last = pending.front().last;
+			pending.pop_front();
+			writing = true;
+		}
+		try{
+			writeBlock( block );
+		}catch( LoggerExpFileError &e ){
+			cerr << e.what() << endl;
+		}
+	}
+}
+
+void
+LoggerCompressedBuffer::writeBlock( const Block & block ){
+	LoggerBlockIndex entry;
+	const char * out = block.data.data();
+	std::string packed;
+
+	entry.first = block.first;
+	entry.last = block.last;
+	entry.offset = offset;
+	entry.rawSize = block.data.size();
+	entry.size = block.data.size();
+	entry.codec = M_LOG_CODEC_STORED;
+#ifdef JPLOGGER_WITH_ZLIB
+	uLongf packedSize = compressBound( block.data.size() );
+	packed.resize( packedSize );
+	// Level 1 favours speed, log text compresses well anyway
+	if( Z_OK == compress2( (Bytef *)&packed[0], &packedSize,
+			(const Bytef *)block.data.data(), block.data.size(), 1 ) &&
+			packedSize < block.data.size() ){
+		out = packed.data();
+		entry.size = packedSize;
+		entry.codec = M_LOG_CODEC_ZLIB;
+	}
+#endif
+	data.write( out, entry.size );
+	data.flush();
+	if( !data.good() )
+		throw LoggerExpFileError("Error writing compressed log",true);
+	offset += entry.size;
+	// The index is written after the block so it never points to missing data
+	index << (long long)entry.first << " " << (long long)entry.last << " " << entry.offset << " "
+			<< entry.size << " " << entry.rawSize << " " << entry.codec << endl;
+}
+
+LoggerCompressedReader::LoggerCompressedReader( std::string filename ){
+	std::ifstream indexFile( (filename + ".idx").c_str() );
+	LoggerBlockIndex entry;
+	long long first, last;
+
+	data.open( filename.c_str(), ios::binary );
+	if( !data.is_open() || !indexFile.is_open() )
+		throw LoggerExpFileError("Compressed log or its index could not be opened",true);
+	while( indexFile >> first >> last >> entry.offset >> entry.size >> entry.rawSize >> entry.codec ){
+		entry.first = first;
+		entry.last = last;
+		blocks.push_back( entry );
+	}
+}
+
+const std::vector<LoggerBlockIndex> &
+LoggerCompressedReader::getBlocks() const{
+	return blocks;
+}
+
+std::string
+LoggerCompressedReader::readBlock( const LoggerBlockIndex & block ){
+	std::string packed( block.size, '\0' );
+	data.clear();
+	data.seekg( block.offset );
+	data.read( &packed[0], block.size );
+	if( (std::streamsize)block.size != data.gcount() )
+		throw LoggerExpFileError("Compressed log is truncated");
+	if( M_LOG_CODEC_STORED == block.codec )
+		return packed;
+#ifdef JPLOGGER_WITH_ZLIB
+	if( M_LOG_CODEC_ZLIB == block.codec ){
+		std::string raw( block.rawSize, '\0' );
+		uLongf rawSize = block.rawSize;
+		if( Z_OK != uncompress( (Bytef *)&raw[0], &rawSize, (const Bytef *)packed.data(), packed.size() ) )
+			throw LoggerExpFileError("Compressed log block is corrupted");
+		raw.resize( rawSize );
+		return raw;
+	}
+#endif
+	throw LoggerExpFileError("Compressed log block uses an unknown codec");
+}
+
+/**
+ * Retrieve the time of a log line
+ * @param line Line starting with the date
+ * @param result Time of the line
+ * @return True if the line starts with a date
+ */
+static bool
+lineTime( const std::string & line, time_t & result ){
+	struct tm tmp;
+	memset( &tmp, 0, sizeof(tmp) );
+	if( NULL == strptime( line.c_str(), "%Y-%m-%d %H:%M:%S", &tmp ) )
+		return false;
+	tmp.tm_isdst = -1;
+	result = mktime( &tmp );
+	return true;
+}
+
+int
+LoggerCompressedReader::read( time_t from, time_t to, std::ostream & out ){
+	std::vector<LoggerBlockIndex>::const_iterator it;
+	std::string raw, line;
+	size_t start, end;
+	time_t when;
+	bool inRange = false, whole, previousRead = false;
+	int read = 0;
+
+	for( it = blocks.begin() ; it != blocks.end() ; ++it ){
+		if( it->last < from || it->first > to ){
+			previousRead = false;
+			continue;
+		}
+		raw = readBlock( *it );
+		read++;
+		// Every line of a block inside the range is in it
+		whole = from <= it->first && it->last <= to;
+		// A line without date goes with the line before it, at the start
+		// of a block it goes with the block, that is in the range. The lines
+		// of layouts that do not start with the date always go with the block
+		if( !previousRead )
+			inRange = true;
+		previousRead = true;
+		for( start = 0 ; start < raw.size() ; start = end + 1 ){
+			end = raw.find( '\n', start );
+			if( std::string::npos == end )
+				end = raw.size();
+			line.assign( raw, start, end - start );
+			if( !whole && lineTime( line, when ) )
+				inRange = from <= when && when <= to;
+			if( whole || inRange )
+				out << line << '\n';
+		}
+		if( whole )
+			inRange = true;
+	}
+	return read;
+}
+#endif
@@ -0,0 +1,236 @@
+#include "libJPLoggerIndex.hpp"
+#ifndef USE_BOOST_INSTEAD_CXX11
+#include <algorithm>
+#include <string.h>
+
+using namespace std;
+using namespace jpCppLibs;
+
+/**
+ * Length of the date at the start of each log
+ */
+static const size_t DATE_LENGTH = 19;
+/**
+ * Number of characters kept from the start of each log
+ */
+static const size_t HEADER_LENGTH = 128;
+
+LoggerIndexedBuffer::LoggerIndexedBuffer( std::string filename, int bucketSeconds ):
+		offset(0),
+		logStart(0),
+		newLog(true){
+	current.bucket = -1;
+	current.seconds = ( bucketSeconds > 0 ) ? bucketSeconds : 1;
+	current.start = current.end = 0;
+	if( NULL == data.open( filename.c_str(), ios::out | ios::app | ios::binary ) ){
+		cerr << "Log file:[" << filename <<
+				"] could not be opened" << endl;
+		throw LoggerExpFileError(true);
+	}
+	index.open( (filename + ".tidx").c_str(), ios::app );
+	if( !index.is_open() )
+		throw LoggerExpFileError("Index of the log file could not be opened",true);
+	offset = data.pubseekoff( 0, ios::end, ios::out );
+}
+
+LoggerIndexedBuffer::~LoggerIndexedBuffer(){
+	writeEntry();
+	data.close();
+}
+
+void
+LoggerIndexedBuffer::drain(){
+	writeEntry();
+	// The logs that follow start a new entry
+	current.bucket = -1;
+	current.modules.clear();
+	data.pubsync();
+}
+
+void
+LoggerIndexedBuffer::keepHeader( const char * s, std::streamsize n ){
+	if( newLog ){
+		header.clear();
+		logStart = offset;
+		newLog = false;
+	}
+	if( header.size() < HEADER_LENGTH )
+		header.append( s, std::min( (size_t)n, HEADER_LENGTH - header.size() ) );
+}
+
+LoggerIndexedBuffer::int_type
+LoggerIndexedBuffer::overflow( int_type c ){
+	char ch;
+	if( traits_type::eq_int_type( c, traits_type::eof() ) )
+		return traits_type::not_eof( c );
+	ch = traits_type::to_char_type( c );
+	keepHeader( &ch, 1 );
+	if( traits_type::eq_int_type( data.sputc( ch ), traits_type::eof() ) )
+		return traits_type::eof();
+	offset++;
+	if( '\n' == ch )
+		indexLog();
+	return c;
+}
+
+std::streamsize
+LoggerIndexedBuffer::xsputn( const char * s, std::streamsize n ){
+	std::streamsize written = data.sputn( s, n ), length;
+	const char * newLine;
+
+	// A write can hold several logs, like the ones kept by a context
+	for( std::streamsize done = 0 ; done < written ; done += length ){
+		newLine = (const char *)memchr( s + done, '\n', written - done );
+		length = ( NULL == newLine ) ? written - done : newLine + 1 - ( s + done );
+		keepHeader( s + done, length );
+		offset += length;
+		if( NULL != newLine )
+			indexLog();
+	}
+	return written;
+}
+
+int
+LoggerIndexedBuffer::sync(){
+	return data.pubsync();
+}
+
+void
+LoggerIndexedBuffer::indexLog(){
+	size_t start, end;
+	time_t now, bucket;
+
+	newLog = true;
+	// The log starts with the date followed by the padded module and [,
+	// other lines like the continuation of a message are not indexed
+	if( header.size() <= DATE_LENGTH || '-' != header[4] || ':' != header[13] )
+		return;
+	start = header.find_first_not_of( ' ', DATE_LENGTH );
+	end = header.find( '[', start );
+	if( std::string::npos == start || std::string::npos == end )
+		return;
+
+	now = time(NULL);
+	bucket = now - now % current.seconds;
+	if( bucket != current.bucket ){
+		writeEntry();
+		current.bucket = bucket;
+		current.start = logStart;
+		current.modules.clear();
+	}
+	current.end = offset;
+	current.modules.insert( header.substr( start, end - start ) );
+}
+
+void
+LoggerIndexedBuffer::writeEntry(){
+	std::set<std::string>::iterator it;
+	if( current.modules.empty() )
+		return;
+	index << (long long)current.bucket << " " << current.seconds << " "
+			<< current.start << " " << current.end << " ";
+	for( it = current.modules.begin() ; it != current.modules.end() ; ++it )
+		index << ( it == current.modules.begin() ? "" : "," ) << *it;
+	index << endl;
+}
+
+LoggerFileIndex::LoggerFileIndex( std::string filename ){
+	std::ifstream indexFile( (filename + ".tidx").c_str() );
+	LoggerIndexEntry entry;
+	std::string modules;
+	long long bucket;
+	size_t start, end;
+
+	while( indexFile >> bucket >> entry.seconds >> entry.start >> entry.end ){
+		entry.bucket = bucket;
+		entry.modules.clear();
+		indexFile.get();
+		std::getline( indexFile, modules );
+		for( start = 0 ; start <= modules.size() ; start = end + 1 ){
+			end = modules.find( ',', start );
+			if( std::string::npos == end )
+				end = modules.size();
+			entry.modules.insert( modules.substr( start, end - start ) );
+		}
+		entries.push_back( entry );
+	}
+}
+
+const std::vector<LoggerIndexEntry> &
+LoggerFileIndex::getEntries() const{
+	return entries;
+}
+
+/**
+ * Check if an entry has logs of a module or of its children
+ * @param entry Entry of the index
+ * @param module Name of the module
+ * @return True if it has
+ */
+static bool
+hasModule( const LoggerIndexEntry & entry, const std::string & module ){
+	std::set<std::string>::const_iterator it = entry.modules.lower_bound( module );
+	if( entry.modules.end() == it )
+		return false;
+	if( *it == module )
+		return true;
+	// Children come right after the module, NET.TCP after NET
+	for( ; entry.modules.end() != it && 0 == it->compare( 0, module.size(), module ) ; ++it )
+		if( it->size() > module.size() && '.' == (*it)[module.size()] )
+			return true;
+	return false;
+}
+
+/**
+ * Order of the entries in the log file
+ */
+static bool
+byStart( const LoggerIndexEntry * a, const LoggerIndexEntry * b ){
+	return a->start < b->start;
+}
+
+/**
+ * Add a part to a list of parts, merging it with the last one
+ * @param result List of parts
+ * @param start Position of the first byte
+ * @param end Position after the last byte
+ */
+static void
+addRange( std::vector<LoggerFileRange> & result, uint64_t start, uint64_t end ){
+	LoggerFileRange range;
+	if( start >= end )
+		return;
+	if( !result.empty() && result.back().end >= start ){
+		result.back().end = std::max( result.back().end, end );
+		return;
+	}
+	range.start = start;
+	range.end = end;
+	result.push_back( range );
+}
+
+std::vector<LoggerFileRange>
+LoggerFileIndex::ranges( time_t from, time_t to, const std::string & module, uint64_t size ) const{
+	std::vector<const LoggerIndexEntry *> sorted;
+	std::vector<const LoggerIndexEntry *>::iterator it;
+	std::vector<LoggerFileRange> result;
+	uint64_t covered = 0;
+
+	for( size_t i = 0 ; i < entries.size() ; i++ )
+		sorted.push_back( &entries[i] );
+	std::sort( sorted.begin(), sorted.end(), byStart );
+	for( it = sorted.begin() ; it != sorted.end() ; ++it ){
+		if( (*it)->start >= size )
+			break;
+		// Logs written before the index was enabled
+		addRange( result, covered, (*it)->start );
+		if( (*it)->bucket + (*it)->seconds > from && (*it)->bucket <= to &&
+				( module.empty() || hasModule( **it, module ) ) )
+			addRange( result, (*it)->start, std::min( (*it)->end, size ) );
+		covered = std::max( covered, std::min( (*it)->end, size ) );
+	}
+	// Logs of the entry that is still being filled
+	addRange( result, covered, size );
+	return result;
+}
+#endif
@@ -0,0 +1,274 @@
+#include "libJPLoggerTail.hpp"
+#ifndef USE_BOOST_INSTEAD_CXX11
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+
+using namespace std;
+using namespace jpCppLibs;
+
+/**
+ * Maximum number of bytes waiting to be sent to a subscriber
+ */
+static const size_t MAX_PENDING = 65536;
+/**
+ * Milliseconds between two reads of the ring
+ */
+static const int POLL_INTERVAL = 10;
+
+const size_t LoggerTail::SLOT_BYTES;
+
+LoggerTail::LoggerTail( std::string path, size_t slots ):
+		path(path),
+		listenFd(-1),
+		ring(NULL),
+		slots( ( slots > 0 ) ? slots : 1 ),
+		head(0),
+		stop(false){
+	struct sockaddr_un address;
+	struct stat status;
+	bool inUse;
+	int probe;
+
+	memset( &address, 0, sizeof(address) );
+	address.sun_family = AF_UNIX;
+	if( path.size() >= sizeof(address.sun_path) )
+		throw LoggerExpFileError("Path of the tail socket is too long",false);
+	memcpy( address.sun_path, path.data(), path.size() );
+	listenFd = socket( AF_UNIX, SOCK_STREAM, 0 );
+	if( -1 == listenFd )
+		throw LoggerExpFileError("Tail socket could not be created",true);
+	// A socket left by a process that ended is replaced, other files
+	// and sockets still accepting connections are kept
+	if( 0 == lstat( path.c_str(), &status ) ){
+		inUse = !S_ISSOCK( status.st_mode );
+		if( !inUse ){
+			probe = socket( AF_UNIX, SOCK_STREAM, 0 );
+			inUse = ( -1 == probe || 0 == connect( probe, (struct sockaddr *)&address, sizeof(address) ) ||
+					ECONNREFUSED != errno );
+			if( -1 != probe )
+				close( probe );
+		}
+		if( inUse ){
+			close( listenFd );
+			throw LoggerExpFileError("Path of the tail socket is in use",false);
+		}
+		unlink( path.c_str() );
+	}
+	if( 0 != bind( listenFd, (struct sockaddr *)&address, sizeof(address) ) ||
+			0 != listen( listenFd, 16 ) ||
+			-1 == fcntl( listenFd, F_SETFL, O_NONBLOCK ) ){
+		close( listenFd );
+		throw LoggerExpFileError("Tail socket could not be opened",true);
+	}
+	ring = new Slot[this->slots];
+	for( size_t i = 0 ; i < this->slots ; i++ )
+		ring[i].sequence.store( 0, std::memory_order_relaxed );
+	worker = std::thread( &LoggerTail::run, this );
+}
+
+LoggerTail::~LoggerTail(){
+	finish();
+	delete[] ring;
+}
+
+void
+LoggerTail::finish(){
+	if( !worker.joinable() )
+		return;
+	stop.store( true );
+	worker.join();
+	for( size_t i = 0 ; i < subscribers.size() ; i++ )
+		close( subscribers[i].fd );
+	subscribers.clear();
+	close( listenFd );
+	unlink( path.c_str() );
+}
+
+void
+LoggerTail::publish( LoggerStringView module, const char * type, LoggerStringView line ){
+	uint64_t position = head.fetch_add( 1, std::memory_order_relaxed ), sequence, word;
+	Slot & slot = ring[position % slots];
+	char record[SLOT_BYTES];
+	size_t typeLength = strlen( type ), moduleLength, lineLength, length;
+
+	moduleLength = std::min( module.size(), (size_t)64 );
+	typeLength = std::min( typeLength, (size_t)16 );
+	lineLength = std::min( line.size(), SLOT_BYTES - moduleLength - typeLength );
+	memcpy( record, module.data(), moduleLength );
+	memcpy( record + moduleLength, type, typeLength );
+	memcpy( record + moduleLength + typeLength, line.data(), lineLength );
+	// Long logs are cut but still end the line
+	if( lineLength < line.size() )
+		record[moduleLength + typeLength + lineLength - 1] = '\n';
+	length = moduleLength + typeLength + lineLength;
+
+	// Take the slot, an older log still being written is waited for
+	// and a newer log already in the slot means this one is lost
+	sequence = slot.sequence.load( std::memory_order_relaxed );
+	do{
+		if( sequence >= 2 * position + 1 )
+			return;
+		if( sequence & 1 ){
+			std::this_thread::yield();
+			sequence = slot.sequence.load( std::memory_order_relaxed );
+			continue;
+		}
+	}while( !slot.sequence.compare_exchange_weak( sequence, 2 * position + 1, std::memory_order_relaxed ) );
+	std::atomic_thread_fence( std::memory_order_release );
+
+	slot.words[0].store( moduleLength | ( typeLength << 8 ) | ( (uint64_t)lineLength << 16 ), std::memory_order_relaxed );
+	for( size_t i = 0 ; i < length ; i += sizeof(word) ){
+		word = 0;
+		memcpy( &word, record + i, std::min( sizeof(word), length - i ) );
+		slot.words[1 + i / sizeof(word)].store( word, std::memory_order_relaxed );
+	}
+	slot.sequence.store( 2 * position + 2, std::memory_order_release );
+}
+
+LoggerTail::ReadResult
+LoggerTail::read( uint64_t position, char * record ){
+	Slot & slot = ring[position % slots];
+	uint64_t sequence = slot.sequence.load( std::memory_order_acquire ), lengths, word;
+	size_t length;
+
+	if( sequence < 2 * position + 2 )
+		return READ_NOT_WRITTEN;
+	if( sequence > 2 * position + 2 )
+		return READ_LOST;
+	lengths = slot.words[0].load( std::memory_order_relaxed );
+	length = std::min( (size_t)( ( lengths & 0xFF ) + ( ( lengths >> 8 ) & 0xFF ) + ( lengths >> 16 ) ), SLOT_BYTES );
+	memcpy( record, &lengths, sizeof(lengths) );
+	for( size_t i = 0 ; i < length ; i += sizeof(word) ){
+		word = slot.words[1 + i / sizeof(word)].load( std::memory_order_relaxed );
+		memcpy( record + sizeof(lengths) + i, &word, std::min( sizeof(word), length - i ) );
+	}
+	// The log was overwritten while it was copied
+	std::atomic_thread_fence( std::memory_order_acquire );
+	if( slot.sequence.load( std::memory_order_relaxed ) != sequence )
+		return READ_LOST;
+	return READ_OK;
+}
+
+void
+LoggerTail::collect( Subscriber & subscriber ){
+	char record[sizeof(uint64_t) + SLOT_BYTES], lostMsg[64];
+	uint64_t last = head.load( std::memory_order_acquire ), lengths, lost = 0;
+	size_t moduleLength, typeLength;
+	const char * module, * type;
+
+	// Logs older than the ring were overwritten
+	if( last - subscriber.next > slots ){
+		lost = last - slots - subscriber.next;
+		subscriber.next = last - slots;
+	}
+	while( subscriber.next < last && subscriber.pending.size() < MAX_PENDING ){
+		ReadResult result = read( subscriber.next, record );
+		if( READ_NOT_WRITTEN == result )
+			break;
+		subscriber.next++;
+		if( READ_LOST == result ){
+			lost++;
+			continue;
+		}
+		if( 0 != lost ){
+			snprintf( lostMsg, sizeof(lostMsg), "Subscriber lost %lu logs\n", (unsigned long)lost );
+			subscriber.pending += lostMsg;
+			lost = 0;
+		}
+		memcpy( &lengths, record, sizeof(lengths) );
+		moduleLength = lengths & 0xFF;
+		typeLength = ( lengths >> 8 ) & 0xFF;
+		module = record + sizeof(lengths);
+		type = module + moduleLength;
+		// Children of the module are also sent, NET.TCP for NET
+		if( !subscriber.module.empty() &&
+				!( moduleLength == subscriber.module.size() && 0 == memcmp( module, subscriber.module.data(), moduleLength ) ) &&
+				!( moduleLength > subscriber.module.size() && '.' == module[subscriber.module.size()] &&
+						0 == memcmp( module, subscriber.module.data(), subscriber.module.size() ) ) )
+			continue;
+		if( !subscriber.type.empty() &&
+				!( typeLength == subscriber.type.size() && 0 == memcmp( type, subscriber.type.data(), typeLength ) ) )
+			continue;
+		subscriber.pending.append( type + typeLength, lengths >> 16 );
+	}
+	if( 0 != lost ){
+		snprintf( lostMsg, sizeof(lostMsg), "Subscriber lost %lu logs\n", (unsigned long)lost );
+		subscriber.pending += lostMsg;
+	}
+}
+
+void
+LoggerTail::run(){
+	std::vector<struct pollfd> fds;
+	char buffer[512];
+	ssize_t count;
+	size_t i, tab, end;
+	int fd;
+
+	while( !stop.load( std::memory_order_relaxed ) ){
+		fds.resize( subscribers.size() + 1 );
+		fds[0].fd = listenFd;
+		fds[0].events = POLLIN;
+		for( i = 0 ; i < subscribers.size() ; i++ ){
+			fds[i + 1].fd = subscribers[i].fd;
+			fds[i + 1].events = POLLIN | ( subscribers[i].pending.empty() ? 0 : POLLOUT );
+		}
+		poll( &fds[0], fds.size(), POLL_INTERVAL );
+
+		while( -1 != (fd = accept( listenFd, NULL, NULL )) ){
+			Subscriber subscriber;
+			fcntl( fd, F_SETFL, O_NONBLOCK );
+			subscriber.fd = fd;
+			subscriber.next = head.load( std::memory_order_acquire );
+			subscriber.ready = false;
+			subscribers.push_back( subscriber );
+		}
+		for( i = 0 ; i < subscribers.size() ; ){
+			Subscriber & subscriber = subscribers[i];
+			bool closed = false;
+			// The filter, anything received after it is ignored
+			while( 0 < (count = recv( subscriber.fd, buffer, sizeof(buffer), 0 )) ){
+				if( subscriber.ready )
+					continue;
+				subscriber.received.append( buffer, count );
+				end = subscriber.received.find( '\n' );
+				if( std::string::npos == end )
+					continue;
+				tab = subscriber.received.find( '\t' );
+				tab = ( tab < end ) ? tab : end;
+				subscriber.module = subscriber.received.substr( 0, tab );
+				subscriber.type = ( tab < end ) ? subscriber.received.substr( tab + 1, end - tab - 1 ) : "";
+				subscriber.received.clear();
+				subscriber.ready = true;
+			}
+			closed = ( 0 == count || ( -1 == count && EAGAIN != errno && EWOULDBLOCK != errno ) );
+			// Send until the ring is empty or the socket is full
+			while( !closed && subscriber.ready ){
+				if( subscriber.pending.empty() )
+					collect( subscriber );
+				if( subscriber.pending.empty() )
+					break;
+				count = send( subscriber.fd, subscriber.pending.data(), subscriber.pending.size(), MSG_NOSIGNAL | MSG_DONTWAIT );
+				if( 0 < count )
+					subscriber.pending.erase( 0, count );
+				else
+					closed = ( EAGAIN != errno && EWOULDBLOCK != errno );
+				if( !subscriber.pending.empty() )
+					break;
+			}
+			if( closed ){
+				close( subscriber.fd );
+				subscribers.erase( subscribers.begin() + i );
+			}else{
+				i++;
+			}
+		}
+	}
+}
+#endif
@@ -0,0 +1,232 @@
+/*
+ ============================================================================
+ Name        : jplogQuery.cpp
+ Author      : Joao Pereira
+ Version     :
+ Copyright   : This library is creating under the MIT license
+ Description : Writes the logs of a log file that match a module, a type
+               and a time window. The file is mapped in memory, the index
+               written by setIndexedFile is used to skip the parts of the
+               file that do not match and the rest is scanned by all cores
+               Usage: jplog-query [-m module] [-t type] [-f from] [-u to] [-j threads] file
+               The times use the format of the log, YYYY-MM-DD HH:MM:SS,
+               and can be shortened, -u 2012-10-05 includes the whole day
+ ============================================================================
+ */
+#include "libJPLoggerIndex.hpp"
+#include <thread>
+#include <atomic>
+#include <limits>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+using namespace jpCppLibs;
+
+/**
+ * Length of the date at the start of each log
+ */
+static const size_t DATE_LENGTH = 19;
+/**
+ * Minimum size of the part of the file scanned by each thread
+ */
+static const uint64_t CHUNK_SIZE = 4 << 20;
+
+/**
+ * Filter of the logs
+ */
+struct Filter{
+  std::string module;
+  std::string type;
+  std::string from;
+  std::string to;
+};
+
+/**
+ * Part of the file scanned by a thread
+ */
+struct Chunk{
+  const char * start;
+  const char * end;
+  std::string result;
+};
+
+/**
+ * Convert a date, that may be shortened, to time
+ * @param date Date in the format of the log
+ * @param fill Date used to complete the shortened date
+ * @param result Time
+ * @return True if the date is valid
+ */
+static bool parseTime( const std::string & date, const char * fill, time_t & result ){
+  std::string full = date + std::string( fill ).substr( std::min( date.size(), DATE_LENGTH ) );
+  struct tm tmp;
+  memset( &tmp, 0, sizeof(tmp) );
+  if( NULL == strptime( full.c_str(), "%Y-%m-%d %H:%M:%S", &tmp ) )
+    return false;
+  tmp.tm_isdst = -1;
+  result = mktime( &tmp );
+  return true;
+}
+
+/**
+ * Check if a log matches the filter
+ * @param line Start of the log
+ * @param length Length of the log
+ * @param filter Filter
+ * @return 1 if it matches, 0 if not and -1 if the line has no header
+ */
+static int matches( const char * line, size_t length, const Filter & filter ){
+  const char * module, * open, * end = line + length;
+  size_t moduleLength;
+
+  if( length <= DATE_LENGTH + 1 || '-' != line[4] || ':' != line[13] )
+    return -1;
+  // Dates of the log are ordered as strings
+  if( !filter.from.empty() && 0 > memcmp( line, filter.from.data(), filter.from.size() ) )
+    return 0;
+  if( !filter.to.empty() && 0 < memcmp( line, filter.to.data(), filter.to.size() ) )
+    return 0;
+  for( module = line + DATE_LENGTH + 1 ; module < end && ' ' == *module ; module++ );
+  open = (const char *)memchr( module, '[', end - module );
+  if( NULL == open )
+    return -1;
+  moduleLength = open - module;
+  if( !filter.module.empty() &&
+      !( moduleLength == filter.module.size() && 0 == memcmp( module, filter.module.data(), moduleLength ) ) &&
+      !( moduleLength > filter.module.size() && '.' == module[filter.module.size()] &&
+         0 == memcmp( module, filter.module.data(), filter.module.size() ) ) )
+    return 0;
+  if( !filter.type.empty() &&
+      ( (size_t)(end - open) < filter.type.size() + 2 || ']' != open[filter.type.size() + 1] ||
+        0 != memcmp( open + 1, filter.type.data(), filter.type.size() ) ) )
+    return 0;
+  return 1;
+}
+
+/**
+ * Find the first log that starts after a position, the lines
+ * without header belong to the log before them so they are skipped
+ * @param start Position to search from
+ * @param end End of the part of the file
+ * @return Start of the log or NULL if there is none
+ */
+static const char * nextLog( const char * start, const char * end ){
+  Filter any;
+  const char * line, * newLine = (const char *)memchr( start, '\n', end - start );
+
+  while( NULL != newLine ){
+    line = newLine + 1;
+    newLine = (const char *)memchr( line, '\n', end - line );
+    if( -1 != matches( line, ( ( NULL == newLine ) ? end : newLine ) - line, any ) )
+      return line;
+  }
+  return NULL;
+}
+
+/**
+ * Scan the chunks, each thread takes the next chunk not scanned
+ * @param chunks Chunks to scan
+ * @param next Position of the next chunk
+ * @param filter Filter
+ */
+static void scan( std::vector<Chunk> * chunks, std::atomic<size_t> * next, const Filter * filter ){
+  size_t i;
+  const char * line, * newLine;
+  int match, keep;
+
+  while( (i = next->fetch_add( 1 )) < chunks->size() ){
+    Chunk & chunk = (*chunks)[i];
+    keep = 0;
+    // memchr of the C library uses vector instructions to find the lines
+    for( line = chunk.start ; line < chunk.end ; line = newLine + 1 ){
+      newLine = (const char *)memchr( line, '\n', chunk.end - line );
+      if( NULL == newLine )
+        newLine = chunk.end;
+      match = matches( line, newLine - line, *filter );
+      // Lines without header belong to the log before them
+      if( -1 != match )
+        keep = match;
+      if( keep )
+        chunk.result.append( line, newLine - line ).push_back( '\n' );
+    }
+  }
+}
+
+int main( int argc, char ** argv ) {
+  Filter filter;
+  unsigned int threads = std::thread::hardware_concurrency();
+  time_t from = 0, to = std::numeric_limits<time_t>::max();
+  struct stat info;
+  const char * data;
+  int opt, fd;
+
+  while( -1 != (opt = getopt( argc, argv, "m:t:f:u:j:" )) ){
+    switch( opt ){
+    case 'm': filter.module = optarg; break;
+    case 't': filter.type = optarg; break;
+    case 'f': filter.from = optarg; break;
+    case 'u': filter.to = optarg; break;
+    case 'j': threads = atoi( optarg ); break;
+    default: optind = argc + 1;
+    }
+  }
+  if( optind != argc - 1 ||
+      ( !filter.from.empty() && !parseTime( filter.from, "0000-01-01 00:00:00", from ) ) ||
+      ( !filter.to.empty() && !parseTime( filter.to, "9999-12-31 23:59:59", to ) ) ){
+    std::cerr << "Usage: " << argv[0] << " [-m module] [-t type] [-f from] [-u to] [-j threads] file" << std::endl;
+    return 1;
+  }
+  if( 0 == threads )
+    threads = 1;
+
+  fd = open( argv[optind], O_RDONLY );
+  if( -1 == fd || 0 != fstat( fd, &info ) ){
+    std::cerr << "Log file:[" << argv[optind] << "] could not be opened" << std::endl;
+    return 1;
+  }
+  if( 0 == info.st_size )
+    return 0;
+  data = (const char *)mmap( NULL, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0 );
+  close( fd );
+  if( MAP_FAILED == data ){
+    std::cerr << "Log file:[" << argv[optind] << "] could not be mapped" << std::endl;
+    return 1;
+  }
+
+  // Split the parts of the file given by the index at the start of logs
+  LoggerFileIndex index( argv[optind] );
+  std::vector<LoggerFileRange> ranges = index.ranges( from, to, filter.module, info.st_size );
+  std::vector<Chunk> chunks;
+  for( size_t i = 0 ; i < ranges.size() ; i++ ){
+    const char * start = data + ranges[i].start, * end = data + ranges[i].end, * split;
+    while( start < end ){
+      Chunk chunk;
+      split = ( (uint64_t)(end - start) > CHUNK_SIZE ) ? nextLog( start + CHUNK_SIZE, end ) : NULL;
+      chunk.start = start;
+      chunk.end = ( NULL == split ) ? end : split;
+      chunks.push_back( chunk );
+      start = chunk.end;
+    }
+  }
+  madvise( (void *)data, info.st_size, MADV_SEQUENTIAL );
+
+  // Scan a few chunks per thread at a time to bound the memory used
+  for( size_t first = 0 ; first < chunks.size() ; first += threads * 4 ){
+    std::vector<Chunk> wave( chunks.begin() + first,
+        chunks.begin() + std::min( chunks.size(), first + threads * 4 ) );
+    std::atomic<size_t> next( 0 );
+    std::vector<std::thread> workers;
+    for( unsigned int i = 1 ; i < threads && i < wave.size() ; i++ )
+      workers.push_back( std::thread( scan, &wave, &next, &filter ) );
+    scan( &wave, &next, &filter );
+    for( size_t i = 0 ; i < workers.size() ; i++ )
+      workers[i].join();
+    for( size_t i = 0 ; i < wave.size() ; i++ )
+      std::cout.write( wave[i].result.data(), wave[i].result.size() );
+  }
+  munmap( (void *)data, info.st_size );
+  return 0;
+}
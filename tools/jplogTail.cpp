@@ -0,0 +1,61 @@
+/*
+ ============================================================================
+ Name        : jplogTail.cpp
+ Author      : Joao Pereira
+ Version     :
+ Copyright   : This library is creating under the MIT license
+ Description : Writes the logs of a running process as they are written,
+               the process must publish them with setTailSocket.
+               Only the logs of the module, and its children, and of
+               the type are received, a line tells the logs lost when
+               this tool does not keep up with the process
+               Usage: jplog-tail [-m module] [-t type] socket
+ ============================================================================
+ */
+#include "libJPLogger.hpp"
+#include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+using namespace jpCppLibs;
+
+int main( int argc, char ** argv ) {
+  std::string module, type, filter;
+  struct sockaddr_un address;
+  char buffer[65536];
+  ssize_t count;
+  int opt, fd;
+
+  while( -1 != (opt = getopt( argc, argv, "m:t:" )) ){
+    switch( opt ){
+    case 'm': module = optarg; break;
+    case 't': type = optarg; break;
+    default: optind = argc + 1;
+    }
+  }
+  memset( &address, 0, sizeof(address) );
+  address.sun_family = AF_UNIX;
+  if( optind != argc - 1 || strlen( argv[optind] ) >= sizeof(address.sun_path) ){
+    std::cerr << "Usage: " << argv[0] << " [-m module] [-t type] socket" << std::endl;
+    return 1;
+  }
+  strcpy( address.sun_path, argv[optind] );
+
+  fd = socket( AF_UNIX, SOCK_STREAM, 0 );
+  if( -1 == fd || 0 != connect( fd, (struct sockaddr *)&address, sizeof(address) ) ){
+    std::cerr << "Socket:[" << argv[optind] << "] could not be opened" << std::endl;
+    return 1;
+  }
+  filter = module + "\t" + type + "\n";
+  if( (ssize_t)filter.size() != send( fd, filter.data(), filter.size(), MSG_NOSIGNAL ) ){
+    std::cerr << "Socket:[" << argv[optind] << "] could not be written" << std::endl;
+    return 1;
+  }
+  while( 0 < (count = recv( fd, buffer, sizeof(buffer), 0 )) ){
+    std::cout.write( buffer, count );
+    std::cout.flush();
+  }
+  close( fd );
+  return 0;
+}
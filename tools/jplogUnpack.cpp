@@ -0,0 +1,51 @@
+/*
+ ============================================================================
+ Name        : jplogUnpack.cpp
+ Author      : Joao Pereira
+ Version     :
+ Copyright   : This library is creating under the MIT license
+ Description : Writes the lines of a compressed log between two times,
+               only the blocks that cover the times are decompressed
+               Usage: jplog-unpack file ["YYYY-MM-DD HH:MM:SS" ["YYYY-MM-DD HH:MM:SS"]]
+ ============================================================================
+ */
+#include "libJPLoggerCompressed.hpp"
+#include <string.h>
+#include <limits>
+
+using namespace jpCppLibs;
+
+/**
+ * Convert a date to time
+ * @param date Date in the format of the log
+ * @param result Time
+ * @return True if the date is valid
+ */
+static bool parseTime( const char * date, time_t & result ){
+  struct tm tmp;
+  memset( &tmp, 0, sizeof(tmp) );
+  if( NULL == strptime( date, "%Y-%m-%d %H:%M:%S", &tmp ) )
+    return false;
+  tmp.tm_isdst = -1;
+  result = mktime( &tmp );
+  return true;
+}
+
+int main( int argc, char ** argv ) {
+  time_t from = 0, to = std::numeric_limits<time_t>::max();
+
+  if( argc < 2 || argc > 4 ||
+      ( argc > 2 && !parseTime( argv[2], from ) ) ||
+      ( argc > 3 && !parseTime( argv[3], to ) ) ){
+    std::cerr << "Usage: " << argv[0] << " file [\"YYYY-MM-DD HH:MM:SS\" [\"YYYY-MM-DD HH:MM:SS\"]]" << std::endl;
+    return 1;
+  }
+  try{
+    LoggerCompressedReader reader( argv[1] );
+    reader.read( from, to, std::cout );
+  }catch( LoggerExpFileError &e ){
+    std::cerr << e.what() << std::endl;
+    return 1;
+  }
+  return 0;
+}